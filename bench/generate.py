@@ -0,0 +1,134 @@
+"""
+Synthetic NDFs for the benchmarks
+
+make_ndf writes an NDF of a chosen size and type filled with noise, with
+a fraction of its pixels set bad, optionally a variance component, and
+an extension tree of a chosen depth for exercising the HDS routines.
+Each level of the tree holds a few scalars, a character array, a small
+numeric array, a structure array and the next level down; the top level
+can also hold one large array.
+"""
+
+import starlink.ndf.api as ndf
+import starlink.hds.api as hds
+
+import numpy as n
+
+# numpy types of the NDF types which can be generated
+TYPES = {
+    '_BYTE'    : n.int8,
+    '_UBYTE'   : n.uint8,
+    '_WORD'    : n.int16,
+    '_UWORD'   : n.uint16,
+    '_INTEGER' : n.int32,
+    '_INT64'   : n.int64,
+    '_REAL'    : n.float32,
+    '_DOUBLE'  : n.float64,
+}
+
+def make_data(shape, ftype='_REAL', bad=0., seed=0):
+    """
+    Returns noise of the given shape (C order) and NDF type with a fraction
+    bad of the pixels set bad: NaN for floating point types, the NDF bad
+    value for integers.
+    """
+    rng = n.random.RandomState(seed)
+    dtype = TYPES[ftype]
+    floating = n.issubdtype(dtype, n.floating)
+    if floating:
+        data = rng.normal(100., 10., shape).astype(dtype)
+    else:
+        # keep clear of the bad values at the ends of the range
+        info = n.iinfo(dtype)
+        data = rng.randint(max(int(info.min)+1, -1000), min(int(info.max), 1000),
+                           shape).astype(dtype)
+    if bad > 0.:
+        mask = rng.random_sample(shape) < bad
+        data[mask] = n.nan if floating else ndf.ndf_getbadpixval(ftype)
+    return data
+
+def make_ndf(fname, shape, ftype='_REAL', bad=0., variance=False, depth=0,
+             width=16, big=0, seed=0):
+    """
+    Writes a synthetic NDF, returning its data.
+
+    fname    -- name of the NDF
+    shape    -- dimensions, C order
+    ftype    -- NDF type of the data (and variance)
+    bad      -- fraction of bad pixels
+    variance -- add a variance component
+    depth    -- number of levels of the extension tree, 0 for none
+    width    -- number of elements in the arrays and structure arrays of
+                each level of the tree
+    big      -- number of elements of a _DOUBLE array BIG at the top of the
+                tree, 0 for none
+    seed     -- seed for the noise
+    """
+    data = make_data(shape, ftype, bad, seed)
+    nan  = bad > 0. and n.issubdtype(data.dtype, n.floating)
+
+    ndim  = len(shape)
+    place = ndf.open(fname, 'WRITE', 'NEW')
+    indf  = place.new(ftype, ndim, n.ones(ndim, dtype=int), n.array(shape[::-1]))
+    try:
+        indf.write('DATA', data, nan=nan)
+        if variance:
+            indf.write('VARIANCE', n.abs(data), nan=nan)
+
+        if depth > 0 or big > 0:
+            loc = hds._transfer(indf.xnew('BENCH', 'BENCH_EXT'))
+            try:
+                if big > 0:
+                    loc.new('BIG', '_DOUBLE', 1, [big])
+                    _put(loc, 'BIG', '_DOUBLE', [big], n.arange(big, dtype=n.float64))
+                if depth > 0:
+                    _fill(loc, depth, width, n.random.RandomState(seed))
+            finally:
+                loc.annul()
+    finally:
+        indf.annul()
+    return data
+
+def _put(loc, name, htype, dims, value):
+    """Writes value to component name of the structure at loc"""
+    comp = loc.find(name)
+    try:
+        comp.put(htype, len(dims), dims, value)
+    finally:
+        comp.annul()
+
+def _fill(loc, depth, width, rng):
+    """Adds depth levels of the extension tree below loc"""
+    loc.new('NAME', '_CHAR*16', 0, [])
+    _put(loc, 'NAME', '_CHAR*16', [], 'level %d' % depth)
+    loc.new('VALUE', '_DOUBLE', 0, [])
+    _put(loc, 'VALUE', '_DOUBLE', [], rng.normal())
+    loc.new('ARRAY', '_REAL', 1, [width])
+    _put(loc, 'ARRAY', '_REAL', [width], rng.normal(size=width))
+    loc.new('CARDS', '_CHAR*80', 1, [width])
+    _put(loc, 'CARDS', '_CHAR*80', [width],
+         ['KEY%-5d= %20.6f / synthetic' % (i, x) for i, x in enumerate(rng.normal(size=width))])
+
+    # a structure array whose cells all hold the same primitives
+    loc.new('ROWS', 'BENCH_ROW', 1, [width])
+    rows = loc.find('ROWS')
+    try:
+        for i in range(width):
+            cell = rows.cell([i])
+            try:
+                cell.new('ID', '_INTEGER', 0, [])
+                _put(cell, 'ID', '_INTEGER', [], i)
+                cell.new('X', '_DOUBLE', 1, [3])
+                _put(cell, 'X', '_DOUBLE', [3], rng.normal(size=3))
+            finally:
+                cell.annul()
+    finally:
+        rows.annul()
+
+    if depth > 1:
+        loc.new('LEVEL', 'BENCH_LEVEL', 0, [])
+        sub = loc.find('LEVEL')
+        try:
+            _fill(sub, depth-1, width, rng)
+        finally:
+            sub.annul()
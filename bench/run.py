@@ -0,0 +1,229 @@
+#!/usr/bin/env python
+"""
+Throughput benchmarks for starlink.ndf and starlink.hds
+
+Writes a synthetic NDF (see generate.py) and times the main routines on
+it, printing a line per benchmark and saving the lot, with details of the
+machine and software, as JSON so that releases can be compared. e.g.
+
+python run.py --shape 2048,2048 --type _REAL --bad 0.01 --depth 4 -o results.json
+
+Each benchmark is repeated and the best time used for the rates: MB/s
+for those which move arrays, calls/s for all. With --stats the counters
+of the api modules (see stats()) are recorded for each benchmark too.
+"""
+
+from __future__ import print_function
+
+import starlink.ndf.api as ndf
+import starlink.hds.api as hds
+from starlink.ndf.Ndf import Ndf
+
+import argparse
+import datetime
+import json
+import os
+import platform
+import shutil
+import tempfile
+from timeit import default_timer as timer
+
+import numpy as n
+
+from generate import make_ndf, TYPES
+
+class Suite(object):
+    """Runs benchmarks and collects their results"""
+
+    def __init__(self, repeat, stats=False):
+        self.repeat  = repeat
+        self.stats   = stats
+        self.results = []
+
+    def run(self, name, func, nbytes=0, number=1):
+        """
+        Times func, called number times per repeat. nbytes is the amount of
+        array data moved per call.
+        """
+        if self.stats:
+            ndf.reset_stats()
+            hds.reset_stats()
+            ndf.enable_stats()
+            hds.enable_stats()
+        try:
+            times = []
+            for i in range(self.repeat):
+                start = timer()
+                for j in range(number):
+                    func()
+                times.append((timer() - start)/number)
+        finally:
+            if self.stats:
+                ndf.enable_stats(False)
+                hds.enable_stats(False)
+
+        best = min(times)
+        result = {'name' : name, 'seconds' : times, 'best' : best,
+                  'calls_per_s' : 1./best if best > 0. else None}
+        line = '%-16s %12.4f ms %12.1f calls/s' % (name, 1000.*best, result['calls_per_s'] or 0.)
+        if nbytes:
+            result['bytes'] = nbytes
+            result['mb_per_s'] = nbytes/best/1.e6 if best > 0. else None
+            line += ' %10.1f MB/s' % (result['mb_per_s'] or 0.)
+        if self.stats:
+            result['stats'] = {'ndf' : ndf.stats(), 'hds' : hds.stats()}
+        self.results.append(result)
+        print(line)
+
+def benchmarks(suite, fname, args, data):
+    """Runs the benchmarks on NDF fname, whose data are data"""
+    nbytes = data.nbytes
+    floating = n.issubdtype(data.dtype, n.floating)
+    calls = args.calls
+
+    def open_annul():
+        ndf.open(fname).annul()
+    suite.run('open', open_annul, number=calls)
+
+    indf = ndf.open(fname, 'UPDATE', 'OLD')
+    try:
+        suite.run('read', lambda: indf.read('DATA'), nbytes)
+        if floating:
+            suite.run('read_nan', lambda: indf.read('DATA', nan=True), nbytes)
+        suite.run('read_view', lambda: indf.read('DATA', copy=False), nbytes)
+        suite.run('subscript', lambda: indf[::2], data[::2].nbytes)
+        suite.run('read_binned', lambda: indf.read_binned('DATA', 8), nbytes)
+        suite.run('statistics', lambda: indf.statistics('DATA'), nbytes)
+        suite.run('sketch', lambda: indf.sketch('DATA'), nbytes)
+        suite.run('histogram', lambda: indf.histogram('DATA', 256, (0., 200.)), nbytes)
+        if args.variance:
+            suite.run('read_many', lambda: indf.read_many(['DATA', 'VARIANCE']), 2*nbytes)
+        suite.run('aread', lambda: indf.aread('CENTRE', 0), number=calls)
+        suite.run('dim', indf.dim, number=calls)
+
+        suite.run('write', lambda: indf.write('DATA', data, nan=floating), nbytes)
+        def map_write():
+            arr = indf.map('DATA', args.type, 'WRITE')
+            arr[...] = data
+            del arr
+            indf.unmap('DATA')
+        suite.run('map_write', map_write, nbytes)
+        def map_update():
+            arr = indf.map('DATA', args.type, 'UPDATE')
+            arr += 1
+            del arr
+            indf.unmap('DATA')
+        suite.run('map_update', map_update, 2*nbytes)
+
+        if args.depth > 0 or args.big > 0:
+            ext = hds._transfer(indf.xloc('BENCH', 'UPDATE'))
+            try:
+                hds_benchmarks(suite, ext, args)
+            finally:
+                ext.annul()
+    finally:
+        indf.annul()
+
+    def load():
+        nd = Ndf(fname)
+        nd.data, nd.var, nd.bound, nd.title, nd.label, nd.units
+        [axis.pos for axis in nd.axes]
+        nd.head.todict()
+        nd.close()
+    suite.run('Ndf', load, nbytes*(2 if args.variance else 1))
+
+def hds_benchmarks(suite, ext, args):
+    """Runs the benchmarks of the HDS extension at locator ext"""
+    if args.big > 0:
+        big = ext.find('BIG')
+        values = n.arange(args.big, dtype=n.float64)
+        try:
+            suite.run('get', big.get, values.nbytes)
+            suite.run('get_slice', lambda: big.get(slice(0, args.big, 10)), values.nbytes//10)
+            suite.run('put', lambda: big.put('_DOUBLE', 1, [args.big], values), values.nbytes)
+            suite.run('put_convert', lambda: big.put('_DOUBLE', 1, [args.big], values[::-1]),
+                      values.nbytes)
+            def map_read():
+                arr = big.map('READ')
+                arr.sum()
+            suite.run('hds_map', map_read, values.nbytes)
+        finally:
+            big.annul()
+
+    if args.depth > 0:
+        value = ext.find('VALUE')
+        try:
+            suite.run('get_scalar', value.get, number=args.calls)
+            suite.run('put_scalar', lambda: value.put('_DOUBLE', 0, [], 1.5), number=args.calls)
+        finally:
+            value.annul()
+        rows = ext.find('ROWS')
+        try:
+            suite.run('records', rows.records)
+        finally:
+            rows.annul()
+        suite.run('tree', ext.tree)
+
+def main():
+    parser = argparse.ArgumentParser(description='Throughput benchmarks for starlink.ndf and starlink.hds')
+    parser.add_argument('--shape', default='1024,1024',
+                        help='dimensions of the data, C order, comma separated')
+    parser.add_argument('--type', default='_REAL', choices=sorted(TYPES),
+                        help='NDF type of the data')
+    parser.add_argument('--bad', type=float, default=0.,
+                        help='fraction of bad pixels')
+    parser.add_argument('--variance', action='store_true',
+                        help='add a variance component')
+    parser.add_argument('--depth', type=int, default=3,
+                        help='depth of the extension tree, 0 for none')
+    parser.add_argument('--width', type=int, default=64,
+                        help='size of the arrays in each level of the extension')
+    parser.add_argument('--big', type=int, default=1000000,
+                        help='elements in the large HDS array, 0 for none')
+    parser.add_argument('--repeat', type=int, default=5,
+                        help='times to repeat each benchmark')
+    parser.add_argument('--calls', type=int, default=100,
+                        help='calls per repeat of the cheap benchmarks')
+    parser.add_argument('--stats', action='store_true',
+                        help='record the api counters for each benchmark')
+    parser.add_argument('--dir', default=None,
+                        help='directory for the synthetic NDF, a temporary one by default')
+    parser.add_argument('-o', '--output', default=None,
+                        help='JSON file for the results')
+    args = parser.parse_args()
+
+    shape = tuple(int(d) for d in args.shape.split(','))
+    tmpdir = args.dir or tempfile.mkdtemp(prefix='ndfbench')
+    fname = os.path.join(tmpdir, 'bench')
+
+    ndf.init()
+    ndf.begin()
+    try:
+        start = timer()
+        data = make_ndf(fname, shape, args.type, args.bad, args.variance,
+                        args.depth, args.width, args.big)
+        print('generated %s %s in %.2f s' % (args.type, shape, timer() - start))
+
+        suite = Suite(args.repeat, args.stats)
+        benchmarks(suite, fname, args, data)
+    finally:
+        ndf.end()
+        if args.dir is None:
+            shutil.rmtree(tmpdir)
+
+    if args.output:
+        params = dict(vars(args))
+        params['shape'] = shape
+        report = {
+            'date'     : datetime.datetime.now().isoformat(),
+            'machine'  : {'node' : platform.node(), 'platform' : platform.platform(),
+                          'processor' : platform.processor()},
+            'software' : {'python' : platform.python_version(), 'numpy' : n.__version__},
+            'params'   : params,
+            'results'  : suite.results,
+        }
+        with open(args.output, 'w') as fout:
+            json.dump(report, fout, indent=1, sort_keys=True)
+
+if __name__ == '__main__':
+    main()
@@ -47,7 +47,13 @@ ndf = Extension('starlink.ndf.api',
                 library_dirs         = library_dirs,
                 runtime_library_dirs = library_dirs,
                 libraries            = libraries,
-                sources              = [os.path.join('starlink', 'ndf', 'ndf.c')]
+                extra_compile_args   = ['-pthread'],
+                extra_link_args      = ['-pthread'],
+                sources              = [os.path.join('starlink', 'ndf', 'ndf.c'),
+                                        os.path.join('starlink', 'ndf', 'kernels.c')],
+                depends              = [os.path.join('starlink', 'ndf', 'kernels.h'),
+                                        os.path.join('starlink', 'ndf', 'star_lock.h'),
+                                        os.path.join('starlink', 'ndf', 'star_stats.h')]
                 )
 
 hds = Extension('starlink.hds.api',
@@ -58,7 +64,9 @@ hds = Extension('starlink.hds.api',
                 library_dirs         = library_dirs,
                 runtime_library_dirs = library_dirs,
                 libraries            = libraries,
-                sources              = [os.path.join('starlink', 'hds','hds.c')]
+                sources              = [os.path.join('starlink', 'hds','hds.c')],
+                depends              = [os.path.join('starlink', 'ndf', 'star_lock.h'),
+                                        os.path.join('starlink', 'ndf', 'star_stats.h')]
                 )
 
 setup(name='starlink-pyndf',
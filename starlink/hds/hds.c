@@ -31,6 +31,9 @@
 // this to build with python2.
 #include "../ndf/npy_3kcompat.h"
 
+// Serialise calls into Starlink with the GIL released
+#include "../ndf/star_lock.h"
+
 #include <stdio.h>
 #include <string.h>
 
@@ -54,6 +57,16 @@ typedef struct {
     PyObject * _locator;
 } HDSObject;
 
+// Define an object to own a mapped primitive. It holds a clone of the
+// locator through which the primitive was mapped, which is unmapped and
+// annulled when the last view of the data disappears.
+
+typedef struct {
+    PyObject_HEAD
+    HDSLoc *_loc;
+    npy_intp _nbytes;
+} HDSMapping;
+
 // Prototypes
 
 static PyObject *
@@ -62,6 +75,10 @@ static HDSLoc *
 HDS_retrieve_locator( HDSObject * self );
 static PyObject*
 pydat_transfer(PyObject *self, PyObject *args);
+static PyObject *
+HDS_read_cells( HDSLoc *loc, int ndim, const hdsdim *tdim, int k,
+                hdsdim *sub, int *status );
+static PyTypeObject HDSMappingType;
 
 // Deallocator. Need to see how this interacts with the PyCapsule deallocator
 
@@ -72,6 +89,23 @@ HDS_dealloc(HDSObject * self)
     PyObject_Del(self);
 }
 
+// Deallocator of a mapping object
+
+static void
+HDSMapping_dealloc(HDSMapping *self)
+{
+    int status = SAI__OK;
+    errBegin(&status);
+    STAR_BEGIN
+    datUnmap(self->_loc, &status);
+    datAnnul(&self->_loc, &status);
+    STAR_END
+    STAR_UNMAPPED(self->_nbytes)
+    if (status != SAI__OK) errAnnul(&status);
+    errEnd(&status);
+    PyObject_Del(self);
+}
+
 // Allocator of an HDS object
 
 static PyObject *
@@ -120,8 +154,9 @@ static void PyDelLoc_ptr(void *ptr)
 {
     HDSLoc* loc = (HDSLoc*)ptr;
     int status = SAI__OK;
+    STAR_BEGIN
     datAnnul(&loc, &status);
-    printf("Inside PyDelLoc\n");
+    STAR_END
     return;
 }
 
@@ -212,18 +247,32 @@ raiseHDSException( int *status )
 static PyObject* 
 pydat_annul(HDSObject *self)
 {
+    STAR_ENTRY
     // Recover C-pointer passed via Python
     HDSLoc* loc = HDS_retrieve_locator(self);
     int status = SAI__OK;
     errBegin(&status);
+    STAR_BEGIN
     datAnnul(&loc, &status);
+    STAR_END
     if(raiseHDSException(&status)) return NULL;
+
+    // The locator has gone so stop the capsule from annulling it again
+    // and leave this object without one
+#ifdef USE_PY3K
+    PyCapsule_SetDestructor(self->_locator, NULL);
+#endif
+    PyObject *tmp = self->_locator;
+    Py_INCREF(Py_None);
+    self->_locator = Py_None;
+    Py_DECREF(tmp);
     Py_RETURN_NONE;
 };
 
 static PyObject* 
 pydat_cell(HDSObject *self, PyObject *args)
 {
+    STAR_ENTRY
     PyObject *pobj1, *osub;
     if(!PyArg_ParseTuple(args, "O:pydat_cell", &osub))
 	return NULL;
@@ -245,7 +294,9 @@ pydat_cell(HDSObject *self, PyObject *args)
     int status = SAI__OK;
     errBegin(&status);
     // Finally run the routine
+    STAR_BEGIN
     datCell(loc1, ndim, rdim, &loc2, &status);
+    STAR_END
     if(status != SAI__OK) goto fail;
 
     // PyCObject to pass pointer along to other wrappers
@@ -261,6 +312,7 @@ fail:
 static PyObject* 
 pydat_index(HDSObject *self, PyObject *args)
 {
+    STAR_ENTRY
     PyObject* pobj;
     int index;
     if(!PyArg_ParseTuple(args, "i:pydat_index", &index))
@@ -272,7 +324,9 @@ pydat_index(HDSObject *self, PyObject *args)
 
     int status = SAI__OK;    
     errBegin(&status);
+    STAR_BEGIN
     datIndex(loc1, index+1, &loc2, &status);
+    STAR_END
     if(raiseHDSException(&status)) return NULL;
     return HDS_create_object(loc2);
 };
@@ -280,6 +334,7 @@ pydat_index(HDSObject *self, PyObject *args)
 static PyObject* 
 pydat_find(HDSObject *self, PyObject *args)
 {
+    STAR_ENTRY
     PyObject* pobj1;
     const char* name;
     if(!PyArg_ParseTuple(args, "s:pydat_find", &name))
@@ -291,39 +346,71 @@ pydat_find(HDSObject *self, PyObject *args)
 
     int status = SAI__OK;    
     errBegin(&status);
+    STAR_BEGIN
     datFind(loc1, name, &loc2, &status);
+    STAR_END
     if (raiseHDSException(&status)) return NULL;
 
     // PyCObject to pass pointer along to other wrappers
     return HDS_create_object(loc2);
 };
 
-static PyObject* 
-pydat_get(HDSObject *self)
-{
-    // Recover C-pointer passed via Python
-    HDSLoc* loc = HDS_retrieve_locator(self);
+// Returns the numpy type number corresponding to HDS type typ, with
+// NPY_STRING for any _CHAR type, or -1 if there is none.
 
-    // guard against structures
-    int state, status = SAI__OK;
-    errBegin(&status);
-    datStruc(loc, &state, &status);
-    if (raiseHDSException(&status)) return NULL;
-    if(state){
-	PyErr_SetString(PyExc_IOError, "dat_get error: cannot use on structures");
-	return NULL;
+static int
+HDS_npy_type( const char *typ )
+{
+    if(strcmp(typ, "_INTEGER") == 0 || strcmp(typ, "_LOGICAL") == 0){
+	return NPY_INT;
+    }else if(strcmp(typ, "_REAL") == 0){
+	return NPY_FLOAT;
+    }else if(strcmp(typ, "_DOUBLE") == 0){
+	return NPY_DOUBLE;
+    }else if(strcmp(typ, "_INT64") == 0){
+	return NPY_INT64;
+    }else if(strncmp(typ, "_CHAR", 5) == 0){
+	return NPY_STRING;
+    }else if(strcmp(typ, "_WORD") == 0){
+	return NPY_SHORT;
+    }else if(strcmp(typ, "_UWORD") == 0){
+	return NPY_USHORT;
+    }else if(strcmp(typ, "_BYTE") == 0){
+	return NPY_BYTE;
+    }else if(strcmp(typ, "_UBYTE") == 0){
+	return NPY_UBYTE;
     }
+    return -1;
+}
 
-    // get type
-    char typ_str[DAT__SZTYP+1];
-    datType(loc, typ_str, &status);
+// Reads the primitive at loc into a numpy array, or a scalar if it has no
+// dimensions. Returns NULL on error, which may be reported either through
+// status or as a Python exception. errBegin must have been called.
 
-    // get shape
+static PyObject *
+HDS_get_primitive( HDSLoc *loc, int *status )
+{
+    // guard against structures, get type, shape and length of strings
+    int state;
+    char typ_str[DAT__SZTYP+1];
     const int NDIMX=7;
     int ndim;
     hdsdim tdim[NDIMX];
-    datShape(loc, NDIMX, tdim, &ndim, &status);
-    if (raiseHDSException(&status)) return NULL;
+    size_t nbytes = 0;
+    STAR_BEGIN
+    datStruc(loc, &state, status);
+    if(!state){
+	datType(loc, typ_str, status);
+	datShape(loc, NDIMX, tdim, &ndim, status);
+	if(*status == SAI__OK && strncmp(typ_str, "_CHAR", 5) == 0)
+	    datLen(loc, &nbytes, status);
+    }
+    STAR_END
+    if (*status != SAI__OK) return NULL;
+    if(state){
+	PyErr_SetString(PyExc_IOError, "dat_get error: cannot use on structures");
+	return NULL;
+    }
 
     PyArrayObject* arr = NULL;
 
@@ -334,63 +421,595 @@ pydat_get(HDSObject *self)
     int i;
     for(i=0; i<ndim; i++) rdim[i] = tdim[ndim-i-1];
 
-    if(strcmp(typ_str, "_INTEGER") == 0 || strcmp(typ_str, "_LOGICAL") == 0){
-	arr = (PyArrayObject*) PyArray_SimpleNew(ndim, rdim, NPY_INT);
-    }else if(strcmp(typ_str, "_REAL") == 0){
-	arr = (PyArrayObject*) PyArray_SimpleNew(ndim, rdim, NPY_FLOAT);
-    }else if(strcmp(typ_str, "_DOUBLE") == 0){
-	arr = (PyArrayObject*) PyArray_SimpleNew(ndim, rdim, NPY_DOUBLE);
-    }else if(strncmp(typ_str, "_CHAR", 5) == 0){
-
-	// work out the number of bytes
-	size_t nbytes;
-	datLen(loc, &nbytes, &status);
-	if (status != SAI__OK) goto fail;
-
-	int ncdim = 1+ndim;
-	int cdim[ncdim];
-	cdim[0] = nbytes+1;
-	for(i=0; i<ndim; i++) cdim[i+1] = rdim[i];
-
+    int typenum = HDS_npy_type(typ_str);
+    if(typenum == NPY_STRING){
 	PyArray_Descr *descr = PyArray_DescrNewFromType(NPY_STRING);
 	descr->elsize = nbytes;
 	arr = (PyArrayObject*) PyArray_NewFromDescr(&PyArray_Type, descr, ndim, rdim, 
 						    NULL, NULL, 0, NULL); 
-
-    }else if(strcmp(typ_str, "_WORD") == 0){
-	arr = (PyArrayObject*) PyArray_SimpleNew(ndim, rdim, NPY_SHORT);
-    }else if(strcmp(typ_str, "_UWORD") == 0){
-	arr = (PyArrayObject*) PyArray_SimpleNew(ndim, rdim, NPY_USHORT);
-    }else if(strcmp(typ_str, "_BYTE") == 0){
-	arr = (PyArrayObject*) PyArray_SimpleNew(ndim, rdim, NPY_BYTE);
-    }else if(strcmp(typ_str, "_UBYTE") == 0){
-	arr = (PyArrayObject*) PyArray_SimpleNew(ndim, rdim, NPY_UBYTE);
+    }else if(typenum >= 0){
+	arr = (PyArrayObject*) PyArray_SimpleNew(ndim, rdim, typenum);
     }else{
 	PyErr_SetString(PyExc_IOError, "dat_get: encountered an unimplemented type");
 	return NULL;
     }
-    if(arr == NULL) goto fail;
-    datGet(loc, typ_str, ndim, tdim, arr->data, &status);
-    if(status != SAI__OK) goto fail;
+    if(arr == NULL) return NULL;
+    STAR_BEGIN
+    datGet(loc, typ_str, ndim, tdim, arr->data, status);
+    STAR_END
+    if(*status != SAI__OK){
+	Py_DECREF(arr);
+	return NULL;
+    }
     return PyArray_Return(arr);
+}
 
-fail:    
-    raiseHDSException(&status);
-    Py_XDECREF(arr);
+// Reads the part of the primitive at loc selected by key: an integer, a
+// slice or a tuple of them in C order, as numpy takes them. HDS can only
+// slice out boxes, so the bounding box of the selection is read and then
+// any steps and integer indices are applied to it. Returns NULL on error
+// as for HDS_get_primitive.
+
+static PyObject *
+HDS_get_slice( HDSLoc *loc, PyObject *key, int *status )
+{
+    int i, k, ndim = 0, struc = 0, post = 0;
+    hdsdim tdim[DAT__MXDIM], lo[DAT__MXDIM], hi[DAT__MXDIM];
+    Py_ssize_t nkey, start, stop, step, len;
+    HDSLoc *slice = NULL;
+    PyObject *index = NULL, *item, *sub, *box = NULL, *value = NULL;
+
+    STAR_BEGIN
+    datStruc(loc, &struc, status);
+    if(!struc) datShape(loc, DAT__MXDIM, tdim, &ndim, status);
+    STAR_END
+    if(*status != SAI__OK) return NULL;
+    if(struc){
+	PyErr_SetString(PyExc_IOError, "dat_get error: cannot use on structures");
+	return NULL;
+    }
+
+    if(PyTuple_Check(key)){
+	Py_INCREF(key);
+    }else{
+	key = Py_BuildValue("(O)", key);
+	if(key == NULL) return NULL;
+    }
+    nkey = PyTuple_GET_SIZE(key);
+    if(nkey > ndim){
+	PyErr_SetString(PyExc_IndexError, "dat_get: too many indices");
+	goto fail;
+    }
+    if(ndim == 0){
+	Py_DECREF(key);
+	return HDS_get_primitive(loc, status);
+    }
+
+    // Convert Python-like --> Fortran-like, dimension by dimension
+    index = PyTuple_New(ndim);
+    if(index == NULL) goto fail;
+    for(k=0; k<ndim; k++){
+	i = ndim-k-1;
+	item = k < nkey ? PyTuple_GET_ITEM(key, k) : NULL;
+	if(item == NULL || PySlice_Check(item)){
+	    if(item == NULL){
+		start = 0;
+		step = 1;
+		len = tdim[i];
+	    }else if(PySlice_GetIndicesEx((void*)item, tdim[i], &start, &stop, &step, &len) < 0){
+		goto fail;
+	    }
+	    if(len == 0){
+		// read one element and take none of it
+		PyObject *zero = PyInt_FromLong(0);
+		lo[i] = hi[i] = 1;
+		sub = zero ? PySlice_New(zero, zero, NULL) : NULL;
+		Py_XDECREF(zero);
+		post = 1;
+	    }else{
+		lo[i] = 1 + (step > 0 ? start : start + (len-1)*step);
+		hi[i] = 1 + (step > 0 ? start + (len-1)*step : start);
+		PyObject *ostep = PyInt_FromLong(step);
+		sub = ostep ? PySlice_New(NULL, NULL, ostep) : NULL;
+		Py_XDECREF(ostep);
+		if(step != 1) post = 1;
+	    }
+	}else{
+	    start = PyNumber_AsSsize_t(item, PyExc_IndexError);
+	    if(start == -1 && PyErr_Occurred()) goto fail;
+	    if(start < 0) start += tdim[i];
+	    if(start < 0 || start >= tdim[i]){
+		PyErr_SetString(PyExc_IndexError, "dat_get: index out of range");
+		goto fail;
+	    }
+	    lo[i] = hi[i] = start+1;
+	    sub = PyInt_FromLong(0);
+	    post = 1;
+	}
+	if(sub == NULL) goto fail;
+	PyTuple_SET_ITEM(index, k, sub);
+    }
+
+    STAR_BEGIN
+    datSlice(loc, ndim, lo, hi, &slice, status);
+    STAR_END
+    if(*status != SAI__OK) goto fail;
+    box = HDS_get_primitive(slice, status);
+    STAR_BEGIN
+    datAnnul(&slice, status);
+    STAR_END
+    if(box == NULL || *status != SAI__OK) goto fail;
+
+    if(post){
+	value = PyObject_GetItem(box, index);
+	// don't hang on to the whole box for a strided view of it
+	if(value && PyArray_Check(value) && !PyArray_ISCONTIGUOUS((PyArrayObject*)value)){
+	    PyObject *copy = PyArray_NewCopy((PyArrayObject*)value, NPY_CORDER);
+	    Py_DECREF(value);
+	    value = copy;
+	}
+	Py_DECREF(box);
+    }else{
+	value = box;
+    }
+    Py_DECREF(index);
+    Py_DECREF(key);
+    return value;
+
+fail:
+    Py_XDECREF(box);
+    Py_XDECREF(index);
+    Py_DECREF(key);
     return NULL;
+}
+
+static PyObject* 
+pydat_get(HDSObject *self, PyObject *args)
+{
+    STAR_ENTRY
+    PyObject *key = NULL;
+    if(!PyArg_ParseTuple(args, "|O:pydat_get", &key))
+	return NULL;
+
+    // Recover C-pointer passed via Python
+    HDSLoc* loc = HDS_retrieve_locator(self);
+
+    int status = SAI__OK;
+    errBegin(&status);
+    PyObject *value = key ? HDS_get_slice(loc, key, &status) : HDS_get_primitive(loc, &status);
+    if (raiseHDSException(&status)) {
+	Py_XDECREF(value);
+	return NULL;
+    }
+    return value;
+};
+
+static PyObject*
+pydat_map(HDSObject *self, PyObject *args)
+{
+    STAR_ENTRY
+    const char *mode = "READ", *type = NULL;
+    if(!PyArg_ParseTuple(args, "|ss:pydat_map", &mode, &type))
+	return NULL;
+
+    // Recover C-pointer passed via Python
+    HDSLoc* loc = HDS_retrieve_locator(self);
+
+    int i, ndim = 0, struc = 0, typenum;
+    hdsdim tdim[DAT__MXDIM];
+    npy_intp rdim[DAT__MXDIM];
+    char typ_str[DAT__SZTYP+1];
+    size_t nbytes = 0;
+    void *ptr = NULL;
+    HDSLoc *clone = NULL;
+    HDSMapping *base = NULL;
+    PyArray_Descr *descr;
+    PyArrayObject *arr;
 
+    int status = SAI__OK;
+    errBegin(&status);
+    STAR_BEGIN
+    datStruc(loc, &struc, &status);
+    if(!struc){
+	if(type == NULL){
+	    datType(loc, typ_str, &status);
+	}else{
+	    strncpy(typ_str, type, DAT__SZTYP);
+	    typ_str[DAT__SZTYP] = '\0';
+	}
+	datShape(loc, DAT__MXDIM, tdim, &ndim, &status);
+	if(status == SAI__OK && strncmp(typ_str, "_CHAR", 5) == 0)
+	    datLen(loc, &nbytes, &status);
+    }
+    STAR_END
+    if(raiseHDSException(&status)) return NULL;
+    if(struc){
+	PyErr_SetString(PyExc_IOError, "dat_map error: cannot use on structures");
+	return NULL;
+    }
+    typenum = HDS_npy_type(typ_str);
+    if(typenum < 0){
+	PyErr_SetString(PyExc_IOError, "dat_map: encountered an unimplemented type");
+	return NULL;
+    }
+    if(typenum == NPY_STRING && type != NULL){
+	PyErr_SetString(PyExc_ValueError, "dat_map: strings can only be mapped as their own type");
+	return NULL;
+    }
+
+    // map through a clone so that the view does not depend on this locator
+    STAR_BEGIN
+    datClone(loc, &clone, &status);
+    datMap(clone, typ_str, mode, ndim, tdim, &ptr, &status);
+    if(status != SAI__OK && clone != NULL) datAnnul(&clone, &status);
+    STAR_END
+    if(raiseHDSException(&status)) return NULL;
+
+    base = PyObject_New(HDSMapping, &HDSMappingType);
+    if(base == NULL){
+	STAR_BEGIN
+	datUnmap(clone, &status);
+	datAnnul(&clone, &status);
+	STAR_END
+	if(status != SAI__OK) errAnnul(&status);
+	errEnd(&status);
+	return NULL;
+    }
+    base->_loc = clone;
+    base->_nbytes = 0;
+
+    // Reverse order Fortran --> C convention
+    for(i=0; i<ndim; i++) rdim[i] = tdim[ndim-i-1];
+    descr = PyArray_DescrNewFromType(typenum);
+    if(descr == NULL){
+	Py_DECREF(base);
+	return NULL;
+    }
+    if(typenum == NPY_STRING) descr->elsize = nbytes;
+    arr = (PyArrayObject*) PyArray_NewFromDescr(&PyArray_Type, descr, ndim, rdim, NULL, ptr,
+						strncmp(mode, "READ", 4) == 0 ? NPY_CARRAY_RO : NPY_CARRAY,
+						NULL);
+    if(arr == NULL){
+	Py_DECREF(base);
+	return NULL;
+    }
+    base->_nbytes = PyArray_NBYTES(arr);
+    STAR_MAPPED(base->_nbytes)
+    // this steals the reference to base, even on failure
+    if(PyArray_SetBaseObject(arr, (PyObject*)base) < 0){
+	Py_DECREF(arr);
+	return NULL;
+    }
+    return (PyObject*)arr;
+};
+
+// Reads the component at loc into dictionary head under its name:
+// primitives as by HDS_get_primitive, scalar structures as dictionaries
+// and arrays of structures as nested lists of dictionaries, one per
+// cell. Undefined primitives are left out. If array is set the
+// components of a scalar structure go straight into head, as is done for
+// the cells of structure arrays (and anything beneath them). Returns -1
+// on error, which may be reported either through status or as a Python
+// exception.
+
+static int
+HDS_read_tree( HDSLoc *loc, PyObject *head, int array, int *status )
+{
+    char name[DAT__SZNAM+1];
+    int i, struc = 0, state = 0, ncomp = 0, ndim = 0, result;
+    hdsdim tdim[DAT__MXDIM], sub[DAT__MXDIM];
+    HDSLoc *loc1 = NULL;
+    PyObject *value = NULL;
+
+    STAR_BEGIN
+    datName(loc, name, status);
+    datStruc(loc, &struc, status);
+    if(struc){
+	datShape(loc, DAT__MXDIM, tdim, &ndim, status);
+	if(ndim == 0) datNcomp(loc, &ncomp, status);
+    }else{
+	datState(loc, &state, status);
+    }
+    STAR_END
+    if(*status != SAI__OK) return -1;
+
+    if(struc && ndim > 0){
+	value = HDS_read_cells(loc, ndim, tdim, 0, sub, status);
+    }else if(struc){
+	if(array){
+	    value = head;
+	    Py_INCREF(value);
+	}else{
+	    value = PyDict_New();
+	}
+	for(i=0; value && i<ncomp; i++){
+	    STAR_BEGIN
+	    datIndex(loc, i+1, &loc1, status);
+	    STAR_END
+	    if(*status != SAI__OK) goto fail;
+	    result = HDS_read_tree(loc1, value, array, status);
+	    STAR_BEGIN
+	    datAnnul(&loc1, status);
+	    STAR_END
+	    if(result < 0 || *status != SAI__OK) goto fail;
+	}
+	if(array){
+	    Py_DECREF(value);
+	    return 0;
+	}
+    }else if(state){
+	value = HDS_get_primitive(loc, status);
+    }else{
+	return 0;
+    }
+    if(value == NULL || PyDict_SetItemString(head, name, value) < 0) goto fail;
+    Py_DECREF(value);
+    return 0;
+
+fail:
+    Py_XDECREF(value);
+    return -1;
+}
+
+// Builds the nested lists of dictionaries for the cells of the structure
+// array at loc, starting from C-order dimension k. sub holds the Fortran
+// subscripts of the cell reached so far.
+
+static PyObject *
+HDS_read_cells( HDSLoc *loc, int ndim, const hdsdim *tdim, int k,
+                hdsdim *sub, int *status )
+{
+    int i, result, fdim = ndim-k-1;
+    HDSLoc *cell = NULL;
+    PyObject *item;
+    PyObject *list = PyList_New(tdim[fdim]);
+    if(list == NULL) return NULL;
+
+    for(i=0; i<tdim[fdim]; i++){
+	sub[fdim] = i+1;
+	if(k < ndim-1){
+	    item = HDS_read_cells(loc, ndim, tdim, k+1, sub, status);
+	    if(item == NULL) goto fail;
+	}else{
+	    item = PyDict_New();
+	    if(item == NULL) goto fail;
+	    PyList_SET_ITEM(list, i, item);
+	    STAR_BEGIN
+	    datCell(loc, ndim, sub, &cell, status);
+	    STAR_END
+	    if(*status != SAI__OK) goto fail;
+	    result = HDS_read_tree(cell, item, 1, status);
+	    STAR_BEGIN
+	    datAnnul(&cell, status);
+	    STAR_END
+	    if(result < 0 || *status != SAI__OK) goto fail;
+	    continue;
+	}
+	PyList_SET_ITEM(list, i, item);
+    }
+    return list;
+
+fail:
+    Py_DECREF(list);
+    return NULL;
+}
+
+static PyObject* 
+pydat_tree(HDSObject *self)
+{
+    STAR_ENTRY
+    // Recover C-pointer passed via Python
+    HDSLoc* loc = HDS_retrieve_locator(self);
+
+    int status = SAI__OK;
+    PyObject *head = PyDict_New();
+    if(head == NULL) return NULL;
+    errBegin(&status);
+    if(HDS_read_tree(loc, head, 0, &status) < 0 || status != SAI__OK){
+	raiseHDSException(&status);
+	Py_DECREF(head);
+	return NULL;
+    }
+    return head;
+};
+
+// One primitive component of the cells of a structure array as gathered
+// by records(), with its byte offset within each record.
+
+typedef struct {
+    char name[DAT__SZNAM+1];
+    char type[DAT__SZTYP+1];
+    int ndim;
+    hdsdim dim[DAT__MXDIM];
+    size_t nbytes;
+    size_t offset;
+} HDSField;
+
+// Fills in fields from the ncomp components of cell. Returns 0 if any
+// of them is a structure or undefined. Must be called between STAR_BEGIN
+// and STAR_END.
+
+static int
+HDS_describe_fields( HDSLoc *cell, int ncomp, HDSField *fields, int *status )
+{
+    int i, struc, state, ok = 1;
+    HDSLoc *comp = NULL;
+    for(i=0; ok && *status == SAI__OK && i<ncomp; i++){
+	struc = state = 0;
+	datIndex(cell, i+1, &comp, status);
+	datName(comp, fields[i].name, status);
+	datStruc(comp, &struc, status);
+	if(*status == SAI__OK && !struc){
+	    datState(comp, &state, status);
+	    datType(comp, fields[i].type, status);
+	    datShape(comp, DAT__MXDIM, fields[i].dim, &fields[i].ndim, status);
+	    fields[i].nbytes = 0;
+	    if(*status == SAI__OK && strncmp(fields[i].type, "_CHAR", 5) == 0)
+		datLen(comp, &fields[i].nbytes, status);
+	}
+	ok = !struc && state;
+	datAnnul(&comp, status);
+    }
+    return ok;
+}
+
+// Reads the components of cell into record rec, as laid out by fields.
+// Returns 0, leaving the record incomplete, if the cell's components do
+// not match fields. Must be called between STAR_BEGIN and STAR_END.
+
+static int
+HDS_gather_fields( HDSLoc *cell, int ncomp, const HDSField *fields, char *rec,
+                   int *status )
+{
+    char type[DAT__SZTYP+1];
+    hdsdim dim[DAT__MXDIM];
+    int i, j, n, there, struc, state, ndim, ok;
+    HDSLoc *comp = NULL;
+
+    datNcomp(cell, &n, status);
+    ok = (n == ncomp);
+    for(i=0; ok && *status == SAI__OK && i<ncomp; i++){
+	datThere(cell, fields[i].name, &there, status);
+	if(*status != SAI__OK || !there) return 0;
+	datFind(cell, fields[i].name, &comp, status);
+	datStruc(comp, &struc, status);
+	ok = !struc;
+	if(ok){
+	    datState(comp, &state, status);
+	    datType(comp, type, status);
+	    datShape(comp, DAT__MXDIM, dim, &ndim, status);
+	    ok = (*status == SAI__OK && state && strcmp(type, fields[i].type) == 0 &&
+		  ndim == fields[i].ndim);
+	    for(j=0; ok && j<ndim; j++) ok = (dim[j] == fields[i].dim[j]);
+	}
+	if(ok) datGet(comp, type, ndim, dim, rec + fields[i].offset, status);
+	datAnnul(&comp, status);
+    }
+    return ok;
+}
+
+static PyObject*
+pydat_records(HDSObject *self)
+{
+    STAR_ENTRY
+    // Recover C-pointer passed via Python
+    HDSLoc* loc = HDS_retrieve_locator(self);
+
+    int i, k, struc = 0, ndim = 0, ncomp = 0, ok = 1;
+    hdsdim tdim[DAT__MXDIM], sub[DAT__MXDIM];
+    npy_intp rdim[DAT__MXDIM], fdim[DAT__MXDIM];
+    size_t j, ncell = 1, itemsize;
+    HDSLoc *cell = NULL;
+    HDSField *fields = NULL;
+    PyObject *list = NULL, *item, *shape, *info;
+    PyArray_Descr *descr = NULL, *fdescr;
+    PyArrayObject *arr = NULL;
+    char *base;
+
+    int status = SAI__OK;
+    errBegin(&status);
+
+    // The components of the first cell decide the fields
+    STAR_BEGIN
+    datStruc(loc, &struc, &status);
+    if(struc){
+	datShape(loc, DAT__MXDIM, tdim, &ndim, &status);
+	for(i=0; i<ndim; i++) sub[i] = 1;
+	if(ndim > 0) datCell(loc, ndim, sub, &cell, &status);
+	datNcomp(ndim > 0 ? cell : loc, &ncomp, &status);
+    }
+    STAR_END
+    if(status == SAI__OK && !struc){
+	PyErr_SetString(PyExc_IOError, "dat_records error: can only be used on structures");
+	goto fail;
+    }
+    if(status != SAI__OK || ncomp == 0) goto fail;
+
+    fields = (HDSField*) PyMem_Malloc(ncomp*sizeof(HDSField));
+    if(fields == NULL){
+	PyErr_NoMemory();
+	goto fail;
+    }
+    STAR_BEGIN
+    ok = HDS_describe_fields(ndim > 0 ? cell : loc, ncomp, fields, &status);
+    if(ndim > 0) datAnnul(&cell, &status);
+    STAR_END
+    if(status != SAI__OK || !ok) goto fail;
+
+    // Build the record type, with dimensions in C order
+    list = PyList_New(ncomp);
+    if(list == NULL) goto fail;
+    for(i=0; i<ncomp; i++){
+	int typenum = HDS_npy_type(fields[i].type);
+	if(typenum < 0) goto fail;
+	fdescr = PyArray_DescrNewFromType(typenum);
+	if(fdescr == NULL) goto fail;
+	if(typenum == NPY_STRING) fdescr->elsize = fields[i].nbytes;
+	for(k=0; k<fields[i].ndim; k++) fdim[k] = fields[i].dim[fields[i].ndim-k-1];
+	shape = PyArray_IntTupleFromIntp(fields[i].ndim, fdim);
+	if(shape == NULL){
+	    Py_DECREF(fdescr);
+	    goto fail;
+	}
+	item = Py_BuildValue("(sNN)", fields[i].name, fdescr, shape);
+	if(item == NULL) goto fail;
+	PyList_SET_ITEM(list, i, item);
+    }
+    if(!PyArray_DescrConverter(list, &descr)) goto fail;
+    for(i=0; i<ncomp; i++){
+	info = PyDict_GetItemString(descr->fields, fields[i].name);
+	if(info == NULL) goto fail;
+	fields[i].offset = PyInt_AsLong(PyTuple_GET_ITEM(info, 1));
+    }
+
+    for(i=0; i<ndim; i++){
+	rdim[i] = tdim[ndim-i-1];
+	ncell *= tdim[i];
+    }
+    arr = (PyArrayObject*) PyArray_Zeros(ndim, rdim, descr, 0);
+    descr = NULL;
+    if(arr == NULL) goto fail;
+
+    // Fortran order of the cells is C order of the records
+    base = PyArray_DATA(arr);
+    itemsize = PyArray_ITEMSIZE(arr);
+    for(i=0; i<ndim; i++) sub[i] = 1;
+    STAR_BEGIN
+    for(j=0; ok && status == SAI__OK && j<ncell; j++){
+	if(ndim > 0) datCell(loc, ndim, sub, &cell, &status);
+	ok = HDS_gather_fields(ndim > 0 ? cell : loc, ncomp, fields, base + j*itemsize, &status);
+	if(ndim > 0) datAnnul(&cell, &status);
+	for(i=0; i<ndim && ++sub[i] > tdim[i]; i++) sub[i] = 1;
+    }
+    STAR_END
+    if(status != SAI__OK || !ok) goto fail;
+
+    PyMem_Free(fields);
+    Py_DECREF(list);
+    return PyArray_Return(arr);
+
+fail:
+    PyMem_Free(fields);
+    Py_XDECREF(list);
+    Py_XDECREF(descr);
+    Py_XDECREF(arr);
+    if(raiseHDSException(&status) || PyErr_Occurred()) return NULL;
+    Py_RETURN_NONE;
 };
 
 static PyObject* 
 pydat_name(HDSObject *self)
 {
+    STAR_ENTRY
     // Recover C-pointer passed via Python
     HDSLoc* loc = HDS_retrieve_locator(self);
 
     char name_str[DAT__SZNAM+1];
     int status = SAI__OK;
     errBegin(&status);
+    STAR_BEGIN
     datName(loc, name_str, &status);
+    STAR_END
     if (raiseHDSException(&status)) return NULL;
     return Py_BuildValue("s", name_str);
 };
@@ -398,12 +1017,15 @@ pydat_name(HDSObject *self)
 static PyObject* 
 pydat_ncomp(HDSObject *self)
 {
+    STAR_ENTRY
     // Recover C-pointer passed via Python
     HDSLoc* loc = HDS_retrieve_locator(self);
 
     int status = SAI__OK, ncomp;
     errBegin(&status);
+    STAR_BEGIN
     datNcomp(loc, &ncomp, &status);
+    STAR_END
     if (raiseHDSException(&status)) return NULL;
 
     return Py_BuildValue("i", ncomp);
@@ -412,6 +1034,7 @@ pydat_ncomp(HDSObject *self)
 static PyObject* 
 pydat_shape(HDSObject *self)
 {
+    STAR_ENTRY
     // Recover C-pointer passed via Python
     HDSLoc* loc = HDS_retrieve_locator(self);
 
@@ -420,7 +1043,9 @@ pydat_shape(HDSObject *self)
     hdsdim tdim[NDIMX];
     int status = SAI__OK;
     errBegin(&status);
+    STAR_BEGIN
     datShape(loc, NDIMX, tdim, &ndim, &status);
+    STAR_END
     if (raiseHDSException(&status)) return NULL;
 
     // Return None in this case
@@ -447,12 +1072,15 @@ fail:
 static PyObject* 
 pydat_state(HDSObject *self, PyObject *args)
 {
+    STAR_ENTRY
     // Recover C-pointer passed via Python
     HDSLoc* loc = HDS_retrieve_locator(self);
 
     int status = SAI__OK, state;
     errBegin(&status);
+    STAR_BEGIN
     datState(loc, &state, &status);
+    STAR_END
     if (raiseHDSException(&status)) return NULL;
     return Py_BuildValue("i", state);
 };
@@ -460,13 +1088,16 @@ pydat_state(HDSObject *self, PyObject *args)
 static PyObject* 
 pydat_struc(HDSObject *self)
 {
+    STAR_ENTRY
     // Recover C-pointer passed via Python
     HDSLoc* loc = HDS_retrieve_locator(self);
 
     // guard against structures
     int state, status = SAI__OK;
     errBegin(&status);
+    STAR_BEGIN
     datStruc(loc, &state, &status);
+    STAR_END
     if (raiseHDSException(&status)) return NULL;
     return Py_BuildValue("i", state);
 };
@@ -474,13 +1105,16 @@ pydat_struc(HDSObject *self)
 static PyObject* 
 pydat_type(HDSObject *self)
 {
+    STAR_ENTRY
     // Recover C-pointer passed via Python
     HDSLoc* loc = HDS_retrieve_locator(self);
 
     char typ_str[DAT__SZTYP+1];
     int status = SAI__OK;
     errBegin(&status);
+    STAR_BEGIN
     datType(loc, typ_str, &status);
+    STAR_END
     if (raiseHDSException(&status)) return NULL;
     return Py_BuildValue("s", typ_str);
 };
@@ -488,122 +1122,219 @@ pydat_type(HDSObject *self)
 static PyObject* 
 pydat_valid(HDSObject *self)
 {
+    STAR_ENTRY
     // Recover C-pointer passed via Python
     HDSLoc* loc = HDS_retrieve_locator(self);
 
     int state, status = SAI__OK;    
     errBegin(&status);
+    STAR_BEGIN
     datValid(loc, &state, &status);
+    STAR_END
     if (raiseHDSException(&status)) return NULL;
 
     return Py_BuildValue("i", state);
 };
 
 // check an HDS type
-inline int checkHDStype(const char *type)
+// Checks that type is an HDS primitive type, raising an exception if not
+
+static int
+checkHDStype(const char *type)
 {
-	if(strcmp(type,"_INTEGER") != 0 && strcmp(type,"_REAL") != 0 && strcmp(type,"_DOUBLE") != 0 &&
-			strcmp(type,"_LOGICAL") != 0 && strcmp(type,"_WORD") != 0 && strcmp(type,"UWORD") != 0 &&
-			strcmp(type,"_BYTE") != 0 && strcmp(type,"_UBYTE") != 0 && strcmp(type,"_CHAR") != 0 &&
-			strncmp(type,"_CHAR*",6) != 0)
+	if(HDS_npy_type(type) < 0 || strcmp(type, "_CHAR*") == 0){
+		PyErr_Format(PyExc_ValueError, "unknown HDS primitive type '%s'", type);
 		return 0;
-	else
-		return 1;
+	}
+	return 1;
 }
 
+// Converts ndim Fortran-ordered dimensions from a sequence to dims.
+// Returns -1 with an exception set on failure.
 
-// make a new primitive
+static int
+HDS_dims(PyObject *dimobj, int ndim, hdsdim *dims)
+{
+	int i;
+	if(ndim < 0 || ndim > DAT__MXDIM){
+		PyErr_SetString(PyExc_ValueError, "number of dimensions out of range");
+		return -1;
+	}
+	if(ndim == 0) return 0;
+	PyArrayObject *npydim = (PyArrayObject*) PyArray_FROM_OTF(dimobj, NPY_INTP, NPY_IN_ARRAY | NPY_FORCECAST);
+	if(npydim == NULL) return -1;
+	if(PyArray_SIZE(npydim) < ndim){
+		PyErr_SetString(PyExc_ValueError, "too few dimensions given");
+		Py_DECREF(npydim);
+		return -1;
+	}
+	npy_intp *ddata = (npy_intp*)PyArray_DATA(npydim);
+	for(i=0; i<ndim; i++) dims[i] = ddata[i];
+	Py_DECREF(npydim);
+	return 0;
+}
+
+// Returns a numpy descriptor matching HDS type, with the length of
+// _CHAR types
+
+static PyArray_Descr *
+HDS_npy_descr(const char *type)
+{
+	PyArray_Descr *descr = PyArray_DescrNewFromType(HDS_npy_type(type));
+	if(descr && strncmp(type, "_CHAR", 5) == 0)
+		descr->elsize = type[5] == '*' ? atoi(type+6) : 1;
+	return descr;
+}
+
+// make a new primitive, or a structure if the type does not start with
+// an underscore
 static PyObject*
 pydat_new(HDSObject *self, PyObject *args)
 {
+	STAR_ENTRY
 	PyObject *dimobj;
 	const char *type, *name;
 	int ndim;
+	hdsdim dims[DAT__MXDIM];
 	if(!PyArg_ParseTuple(args, "ssiO:pydat_new", &name, &type, &ndim, &dimobj))
 		return NULL;
 	HDSLoc* loc = HDS_retrieve_locator(self);
-	if(!checkHDStype(type))
+	if((type[0] == '_' && !checkHDStype(type)) || HDS_dims(dimobj, ndim, dims) < 0)
 		return NULL;
 	int status = SAI__OK;
-        errBegin(&status);
-	if (ndim > 0) {
-		PyArrayObject *npydim = (PyArrayObject*) PyArray_FROM_OTF(dimobj,NPY_INT,NPY_IN_ARRAY|NPY_FORCECAST);
-		hdsdim *dims = (hdsdim*)PyArray_DATA(npydim);
-		datNew(loc,name,type,ndim,dims,&status);
-		Py_DECREF(npydim);
-	} else {
-		datNew(loc,name,type,0,0,&status);
-	}
+	errBegin(&status);
+	STAR_BEGIN
+	datNew(loc,name,type,ndim,dims,&status);
+	STAR_END
 	if (raiseHDSException(&status))
 		return NULL;
 	Py_RETURN_NONE;
 }
 
 
-// write a primitive
+// write a primitive. Numeric arrays already laid out as HDS wants them
+// are written straight from their memory; anything else is converted as
+// it is copied into the mapped primitive.
 static PyObject*
 pydat_put(HDSObject *self, PyObject *args)
 {
+	STAR_ENTRY
 	PyObject *value, *dimobj;
-	PyArrayObject *npyval;
+	PyArrayObject *npyval = NULL, *mapped = NULL;
+	PyArray_Descr *descr;
 	const char* type;
-	int ndim;
+	int i, ndim, copied;
+	npy_intp nelem = 1;
+	hdsdim dims[DAT__MXDIM];
+	npy_intp rdim[DAT__MXDIM];
+	HDSLoc *clone = NULL;
+	void *ptr = NULL;
 	if(!PyArg_ParseTuple(args,"siOO:pydat_put",&type,&ndim,&dimobj,&value))
 		return NULL;
-	if(!checkHDStype(type))
+	if(!checkHDStype(type) || HDS_dims(dimobj, ndim, dims) < 0)
 		return NULL;
 	HDSLoc* loc = HDS_retrieve_locator(self);
-	// create a pointer to an array of the appropriate data type
-	if(strcmp(type,"_INTEGER") == 0) {
-		npyval = (PyArrayObject*) PyArray_FROM_OTF(value, NPY_INT, NPY_IN_ARRAY | NPY_FORCECAST);
-	} else if(strcmp(type,"_REAL") == 0) {
-		npyval = (PyArrayObject*) PyArray_FROM_OTF(value, NPY_FLOAT, NPY_IN_ARRAY | NPY_FORCECAST);
-	} else if(strcmp(type,"_DOUBLE") == 0) {
-		npyval = (PyArrayObject*) PyArray_FROM_OTF(value, NPY_DOUBLE, NPY_IN_ARRAY | NPY_FORCECAST);
-	} else if(strcmp(type,"_BYTE") == 0) {
-		npyval = (PyArrayObject*) PyArray_FROM_OTF(value, NPY_BYTE, NPY_IN_ARRAY | NPY_FORCECAST);
-	} else if(strcmp(type,"_UBYTE") == 0) {
-		npyval = (PyArrayObject*) PyArray_FROM_OTF(value, NPY_UBYTE, NPY_IN_ARRAY | NPY_FORCECAST);
-	} else if(strncmp(type,"_CHAR*",6) == 0) {
-		npyval = (PyArrayObject*) PyArray_FROM_OT(value, NPY_STRING);
-	} else {
+	descr = HDS_npy_descr(type);
+	if(descr == NULL)
 		return NULL;
-	}
-	void *valptr = PyArray_DATA(npyval);
+	for(i=0; i<ndim; i++) nelem *= dims[i];
+
 	int status = SAI__OK;
-        errBegin(&status);
-	if (ndim > 0) {
-		// npydim is 1-D array stating the size of each dimension ie. npydim = numpy.array([1072 1072])
-		// these are stored in an hdsdim type (note these are declared as signed)
-		PyArrayObject *npydim = (PyArrayObject*) PyArray_FROM_OTF(dimobj,NPY_INT,NPY_IN_ARRAY|NPY_FORCECAST);
-		hdsdim *dims = (hdsdim*)PyArray_DATA(npydim);
+	errBegin(&status);
+	if(strncmp(type, "_CHAR", 5) != 0 && PyArray_Check(value) &&
+	   PyArray_SIZE((PyArrayObject*)value) == nelem &&
+	   PyArray_ISCARRAY_RO((PyArrayObject*)value) && PyArray_ISNOTSWAPPED((PyArrayObject*)value) &&
+	   PyArray_EquivTypes(PyArray_DESCR((PyArrayObject*)value), descr)){
+		Py_DECREF(descr);
+		npyval = (PyArrayObject*)value;
+		void *valptr = PyArray_DATA(npyval);
+		STAR_BEGIN
 		datPut(loc,type,ndim,dims,valptr,&status);
-		Py_DECREF(npydim);
+		STAR_END
 	} else {
-		datPut(loc,type,0,0,valptr,&status);
+		npyval = (PyArrayObject*) PyArray_FromAny(value, NULL, 0, 0, 0, NULL);
+		if(npyval == NULL){
+			Py_DECREF(descr);
+			errEnd(&status);
+			return NULL;
+		}
+		// a clone left unmapped is annulled in a new error context so
+		// that it goes even though status is bad
+		STAR_BEGIN
+		datClone(loc,&clone,&status);
+		datMap(clone,type,"WRITE",ndim,dims,&ptr,&status);
+		if(status != SAI__OK && clone != NULL){
+			errBegin(&status);
+			datAnnul(&clone,&status);
+			errEnd(&status);
+		}
+		STAR_END
+		if(status != SAI__OK){
+			Py_DECREF(descr);
+			Py_DECREF(npyval);
+			goto fail;
+		}
+
+		// Reverse order Fortran --> C convention
+		for(i=0; i<ndim; i++) rdim[i] = dims[ndim-i-1];
+		npy_intp mbytes = nelem*descr->elsize;
+		STAR_MAPPED(mbytes)
+		mapped = (PyArrayObject*) PyArray_NewFromDescr(&PyArray_Type, descr, ndim, rdim,
+							       NULL, ptr, NPY_CARRAY, NULL);
+		STAR_COPY_BEGIN
+		copied = mapped != NULL && PyArray_CopyAnyInto(mapped, npyval) == 0;
+		STAR_COPY_END(mbytes)
+		if(copied && strncmp(type, "_CHAR", 5) == 0){
+			// numpy pads strings with nulls, HDS with blanks
+			char *cptr = (char*)ptr;
+			npy_intp j, nbytes = PyArray_NBYTES(mapped);
+			for(j=0; j<nbytes; j++) if(cptr[j] == '\0') cptr[j] = ' ';
+		}
+		Py_XDECREF(mapped);
+		Py_DECREF(npyval);
+
+		STAR_BEGIN
+		datUnmap(clone,&status);
+		if(!copied) datReset(clone,&status);
+		datAnnul(&clone,&status);
+		STAR_END
+		STAR_UNMAPPED(mbytes)
+		if(!copied){
+			if(status != SAI__OK) errAnnul(&status);
+			errEnd(&status);
+			return NULL;
+		}
 	}
 	if (raiseHDSException(&status))
 		return NULL;
-	Py_DECREF(npyval);
 	Py_RETURN_NONE;
+
+fail:
+	raiseHDSException(&status);
+	return NULL;
 }
 
 static PyObject*
 pydat_putc(HDSObject *self, PyObject *args)
 {
-	PyObject *strobj,*locobj;
+	STAR_ENTRY
+	PyObject *strobj;
 	int strlen;
 	if(!PyArg_ParseTuple(args,"Oi:pydat_putc",&strobj,&strlen))
 		return NULL;
 	HDSLoc *loc = HDS_retrieve_locator(self);
 	PyArrayObject *npystr = (PyArrayObject*) PyArray_FROM_OTF(strobj,NPY_STRING,NPY_FORCECAST);
+	if(npystr == NULL)
+		return NULL;
 	char *strptr = PyArray_DATA(npystr);
 	int status = SAI__OK;
-        errBegin(&status);
+	errBegin(&status);
+	STAR_BEGIN
 	datPutC(loc,0,0,strptr,(size_t)strlen,&status);
+	STAR_END
+	Py_DECREF(npystr);
 	if (raiseHDSException(&status))
 		return NULL;
-	Py_DECREF(npystr);
 	Py_RETURN_NONE;
 }
 
@@ -636,8 +1367,14 @@ static PyMethodDef HDS_methods[] = {
   {"find", (PyCFunction)pydat_find, METH_VARARGS,
    "loc2 = hdsloc1.find(name) -- finds a named component, returns locator."},
 
-  {"get", (PyCFunction)pydat_get, METH_NOARGS,
-   "value = hdsloc.get() -- get data associated with locator regardless of type."},
+  {"get", (PyCFunction)pydat_get, METH_VARARGS,
+   "value = hdsloc.get(sub=None) -- get data associated with locator regardless of type. sub selects part of an\n"
+   "array primitive as numpy would, with integers and slices in C order, and only that part is read."},
+
+  {"map", (PyCFunction)pydat_map, METH_VARARGS,
+   "arr = hdsloc.map(mode='READ', type=None) -- maps a primitive, returning a numpy array of its shape (C order)\n"
+   "viewing the mapped data, in its own type unless another is given. The array may be written to unless mode is\n"
+   "'READ', and the data are unmapped once the array and any views of it have gone."},
 
   {"name", (PyCFunction)pydat_name, METH_NOARGS,
    "name_str = hdsloc.name() -- returns name of components."},
@@ -645,6 +1382,11 @@ static PyMethodDef HDS_methods[] = {
   {"ncomp", (PyCFunction)pydat_ncomp, METH_NOARGS,
    "ncomp = hdsloc.ncomp() -- return number of components."},
 
+  {"records", (PyCFunction)pydat_records, METH_NOARGS,
+   "recs = hdsloc.records() -- reads an array of structures whose cells all hold the same defined primitives (same\n"
+   "names, types and shapes) into a numpy structured array of its shape, one field per component. Returns None if the\n"
+   "cells differ or hold structures. A scalar structure gives a single record."},
+
   {"shape", (PyCFunction)pydat_shape, METH_NOARGS,
    "dim = loc.shape() -- returns shape of the component. dim=None for a scalar"},
 
@@ -654,6 +1396,10 @@ static PyMethodDef HDS_methods[] = {
   {"struc", (PyCFunction)pydat_struc, METH_NOARGS,
    "state = hdsloc.struc() -- is the component a structure."},
 
+  {"tree", (PyCFunction)pydat_tree, METH_NOARGS,
+   "head = hdsloc.tree() -- reads the component and everything beneath it into a dictionary keyed by its name. Structures\n"
+   "become dictionaries and arrays of structures nested lists of dictionaries holding the components of each cell."},
+
   {"type", (PyCFunction)pydat_type, METH_NOARGS,
    "typ_str = hdsloc.type() -- returns type of the component"},
 
@@ -661,14 +1407,17 @@ static PyMethodDef HDS_methods[] = {
    "state = hdsloc.valid() -- is locator valid?"},
 
   {"put", (PyCFunction)pydat_put, METH_VARARGS,
-   "status = hdsloc.put(type,ndim,dim,value) -- write a primitive inside an hds item."},
+   "hdsloc.put(type,ndim,dim,value) -- write a primitive inside an hds item. dim is in Fortran order. Contiguous\n"
+   "arrays of the matching type are written without a copy, anything else is converted as it is written."},
 
   {"new", (PyCFunction)pydat_new, METH_VARARGS,
-   "hdsloc.new(name,type,ndim,dim) -- create a primitive given a locator."},
+   "hdsloc.new(name,type,ndim,dim) -- create a primitive given a locator, or a structure if type does not start with '_'."},
 
   {"putc", (PyCFunction)pydat_putc, METH_VARARGS,
    "hdsloc.putc(string) -- write a character string to primitive at locator."},
 
+  STAR_STATS_METHODS
+
   {NULL, NULL, 0, NULL} /* Sentinel */
 };
 
@@ -714,15 +1463,45 @@ static PyTypeObject HDSType = {
     HDS_new,                 /* tp_new */
 };
 
+static PyTypeObject HDSMappingType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "starlink.hds.api.mapping",             /* tp_name */
+    sizeof(HDSMapping),             /* tp_basicsize */
+    0,                         /* tp_itemsize */
+    (destructor)HDSMapping_dealloc, /* tp_dealloc */
+    0,                         /* tp_print */
+    0,                         /* tp_getattr */
+    0,                         /* tp_setattr */
+    0,                         /* tp_reserved */
+    0,                         /* tp_repr */
+    0,                         /* tp_as_number */
+    0,                         /* tp_as_sequence */
+    0,                         /* tp_as_mapping */
+    0,                         /* tp_hash  */
+    0,                         /* tp_call */
+    0,                         /* tp_str */
+    0,                         /* tp_getattro */
+    0,                         /* tp_setattro */
+    0,                         /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,        /* tp_flags */
+    "Owner of a mapped HDS primitive",           /* tp_doc */
+};
+
 // Helper to create an object with an HDS locator
 
 static PyObject *
 HDS_create_object( HDSLoc * locator )
 {
-  PyObject * pobj;
+  PyObject * args;
   HDSObject * self = (HDSObject*)HDS_new( &HDSType, NULL, NULL );
-  pobj = NpyCapsule_FromVoidPtr( locator, PyDelLoc );
-  HDS_init( self, Py_BuildValue("O", pobj ), NULL);
+  if (!self) return NULL;
+  args = Py_BuildValue("(N)", NpyCapsule_FromVoidPtr( locator, PyDelLoc ));
+  if (!args || HDS_init( self, args, NULL) < 0) {
+    Py_XDECREF(args);
+    Py_DECREF(self);
+    return NULL;
+  }
+  Py_DECREF(args);
 
   return (PyObject*)self;
 }
@@ -730,7 +1509,7 @@ HDS_create_object( HDSLoc * locator )
 static HDSLoc *
 HDS_retrieve_locator( HDSObject *self)
 {
-  if (self) {
+  if (self && self->_locator != Py_None) {
     return (HDSLoc*)NpyCapsule_AsVoidPtr(self->_locator);
   } else {
     return NULL;
@@ -740,6 +1519,7 @@ HDS_retrieve_locator( HDSObject *self)
 static PyObject*
 pydat_transfer(PyObject *self, PyObject *args)
 {
+  STAR_ENTRY
   HDSObject * newself = (HDSObject*)HDS_new( &HDSType, NULL, NULL );
   if (!newself) return NULL;
   HDS_init( newself, args, NULL);
@@ -775,6 +1555,8 @@ initapi(void)
 
     if (PyType_Ready(&HDSType) < 0)
         return RETVAL;
+    if (PyType_Ready(&HDSMappingType) < 0)
+        return RETVAL;
 
 #ifdef USE_PY3K
     m = PyModule_Create(&moduledef);
@@ -787,6 +1569,11 @@ initapi(void)
     Py_INCREF(&HDSType);
     PyModule_AddObject(m, "api", (PyObject *)&HDSType);
 
+    if (star_lock_import() < 0) {
+        m = NULL;
+        return RETVAL;
+    }
+
     StarlinkHDSError = PyErr_NewException("starlink.hds.error", NULL, NULL);
     Py_INCREF(StarlinkHDSError);
     PyModule_AddObject(m, "error", StarlinkHDSError);
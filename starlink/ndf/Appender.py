@@ -0,0 +1,128 @@
+import starlink.ndf.api as ndf
+
+import math
+import numpy as n
+
+class Appender(object):
+    """
+    Writes frames one after another into a single NDF, stacking them along
+    its last pixel axis, which is the first axis of the numpy arrays.
+
+    Room is made for frames in advance and grows geometrically as it runs
+    out, so the cost of extending the NDF is spread over many frames.
+    Closing the Appender trims the NDF to the frames actually written,
+    or deletes it if none were, as an NDF cannot have an empty axis.
+    For instance
+
+    app = Appender('cube', (512,1024))
+    for frame in frames:
+        app.append(frame)
+    app.close()
+
+    Appenders can also be used in with statements, which close them.
+
+    Attributes:
+
+    nframe -- number of frames in the NDF so far
+    growth -- factor by which the room for frames grows
+    """
+
+    def __init__(self, fname, shape=None, ftype='_REAL', capacity=16, growth=2.):
+        """
+        Opens an NDF to append frames to.
+
+        fname    -- name of the NDF
+        shape    -- shape of the frames. If given, a new NDF is created with
+                    room for capacity frames. If not, an existing NDF is opened
+                    for update and frames are added after those it has.
+        ftype    -- data type of a new NDF
+        capacity -- number of frames to make room for at first
+        growth   -- factor by which the room for frames grows when needed
+        """
+        if growth <= 1.:
+            raise ValueError('Appender: growth must be more than 1')
+        self.growth = growth
+
+        if shape is None:
+            self._indf = ndf.open(fname, 'UPDATE', 'OLD')
+            bound = self._indf.bound()
+            self._lbnd = [int(b) for b in bound[0]]
+            self._ubnd = [int(b) for b in bound[1]]
+            self.nframe = self._ubnd[0] - self._lbnd[0] + 1
+        else:
+            self.nframe = 0
+            self._lbnd = [1]*(len(shape)+1)
+            self._ubnd = [max(1, int(capacity))] + [int(d) for d in shape]
+            place = ndf.open(fname, 'WRITE', 'NEW')
+            # new() wants its bounds in Fortran order
+            self._indf = place.new(ftype, len(self._lbnd),
+                                   n.array(self._lbnd[::-1]), n.array(self._ubnd[::-1]))
+        self._capacity = self._ubnd[0] - self._lbnd[0] + 1
+        self._fshape = tuple(u - l + 1 for l, u in zip(self._lbnd[1:], self._ubnd[1:]))
+
+    def append(self, data, var=None, quality=None):
+        """
+        Appends a frame, or a batch of frames stacked along the first axis,
+        with optional variances and quality of the same shape.
+        """
+        data = self._frames(data)
+        nnew = data.shape[0]
+        if self.nframe + nnew > self._capacity:
+            self._resize(max(self.nframe + nnew,
+                             int(math.ceil(self._capacity*self.growth))))
+
+        first = self._lbnd[0] + self.nframe
+        sect  = self._indf.sect([first] + self._lbnd[1:],
+                                [first + nnew - 1] + self._ubnd[1:])
+        try:
+            sect.write('DATA', data)
+            if var is not None:
+                sect.write('VARIANCE', self._frames(var, nnew))
+            if quality is not None:
+                sect.write('QUALITY', self._frames(quality, nnew))
+        finally:
+            sect.annul()
+        self.nframe += nnew
+
+    def close(self):
+        """
+        Trims the NDF to the frames written and closes it. A new NDF to
+        which no frames were written is deleted.
+        """
+        if self._indf is None:
+            return
+        if self.nframe == 0:
+            indf, self._indf = self._indf, None
+            indf.delet()
+            return
+        try:
+            if self.nframe != self._capacity:
+                self._resize(self.nframe)
+        finally:
+            self._indf.annul()
+            self._indf = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+        return False
+
+    def _frames(self, arr, nframe=None):
+        """Returns arr as a stack of frames, checking its shape"""
+        arr = n.asarray(arr)
+        if arr.shape == self._fshape:
+            arr = arr[n.newaxis]
+        if arr.shape[1:] != self._fshape or (nframe is not None and arr.shape[0] != nframe):
+            raise ValueError('Appender: frames have shape ' + str(arr.shape) +
+                             ', expected ' + str(self._fshape))
+        return arr
+
+    def _resize(self, capacity):
+        """Changes the room for frames"""
+        ubnd = list(self._ubnd)
+        ubnd[0] = self._lbnd[0] + capacity - 1
+        self._indf.sbnd(self._lbnd, ubnd)
+        self._ubnd = ubnd
+        self._capacity = capacity
@@ -1,3 +1,4 @@
+from starlink.ndf.lazy import lazy
 
 class Axis(object):
     """
@@ -10,12 +11,31 @@ class Axis(object):
     width  -- widths of pixels
     label  -- character string label.
     units  -- units of the axis
+
+    Each attribute is read from the NDF when it is first accessed.
     """
 
     def __init__(self, indf, iaxis):
         """Initialise an NDF axis."""
-        self.pos   = indf.aread('Centre',iaxis)
-        self.var   = indf.aread('Variance',iaxis)
-        self.width = indf.aread('Width',iaxis)
-        self.label = indf.acget('Label',iaxis)
-        self.units = indf.acget('Units',iaxis)
+        self._indf  = indf
+        self._iaxis = iaxis
+
+    @lazy
+    def pos(self):
+        return self._indf.aread('Centre',self._iaxis)
+
+    @lazy
+    def var(self):
+        return self._indf.aread('Variance',self._iaxis)
+
+    @lazy
+    def width(self):
+        return self._indf.aread('Width',self._iaxis)
+
+    @lazy
+    def label(self):
+        return self._indf.acget('Label',self._iaxis)
+
+    @lazy
+    def units(self):
+        return self._indf.acget('Units',self._iaxis)
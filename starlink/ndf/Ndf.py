@@ -1,9 +1,15 @@
 import starlink.ndf.api as ndf
 import starlink.hds.api as hds
 from starlink.ndf.Axis import Axis
+from starlink.ndf.lazy import lazy
 
 import re
 import numpy as n
+from collections import OrderedDict
+try:
+    from collections.abc import Mapping
+except ImportError:
+    from collections import Mapping
 
 
 class Ndf(object):
@@ -17,7 +23,7 @@ class Ndf(object):
     axes  -- a list of Axis object, one for each dimension of data
     label -- label associated with the data
     title -- title associated with the data
-    head  -- dictionary of header information
+    head  -- dictionary-like view of header information
 
     Complete information on NDFs can be obtained from sun33 of the Starlink documentation
     and may illuminate the meaning of some of these.
@@ -27,8 +33,12 @@ class Ndf(object):
         """
         Initialise an NDF from a file.
 
-        This slurps the whole thing in, including all extensions, axes etc. This could
-        cause memory problems on large files. You can use either standard format
+        Only the NDF is opened here; each attribute is read the first time it is
+        accessed and kept thereafter, so looking at the title of a large file costs
+        little. Reading data from very large files could still cause memory problems
+        (the iter_chunks method of the low-level API reads components piece by piece
+        instead). The NDF stays open until the object is deleted or its close method
+        is called. You can use either standard format
         NDF sections in such case or Pythonic ones. e.g. Given an NDF 'image' listed by
         hdstrace to have a data array DATA(3,4,5), the entire image can be specified
         using any of 'image', 'image(1:3,1:4,1:5)' or 'image[0:5,0:4,0:3]' where as usual
@@ -41,7 +51,7 @@ class Ndf(object):
         ndf = starlink.ndf.Ndf('image')
         subim = image.data[0:5,0:4,0:3]
 
-        The following attributes are created:
+        The following attributes are available:
 
         data    -- the data array, a numpy N-d array
         bound   -- pixel limits of data array. 2xndim array of lower and upper bounds
@@ -50,7 +60,7 @@ class Ndf(object):
         label   -- label string
         title   -- title string
         units   -- data unit string
-        head    -- header/extensions, a dictionary
+        head    -- header/extensions, an HdsMapping which reads each one when it is looked up
         """
         object.__init__(self)
 
@@ -81,83 +91,121 @@ class Ndf(object):
             nname += add + ')'
             fname = nname
 
-        # OK, get on with NDF stuff
+        # OK, get on with NDF stuff. The identifier stays open for as long
+        # as this object exists so that components can be read when wanted.
         ndf.init()
-        ndf.begin()
-        try:
-            indf = ndf.open(fname)
-            self.data  = indf.read('Dat')
-            self.bound = indf.bound()
-            self.var   = indf.read('Var')
-            self.label = indf.cget('Label')
-            self.title = indf.cget('Title')
-            self.units  = indf.cget('Units')
-
-            # Read the axes
-            self.axes = []
-            for nax in range(self.data.ndim):
-                self.axes.append(Axis(indf, nax))
-
-            # Read the extensions
-            self.head = {}
-            nextn = indf.xnumb()
-            for nex in range(nextn):
-                xname = indf.xname(nex)
-                loc1 = indf.xloc(xname, 'READ')
-                hdsloc = hds._transfer(loc1)
-                _read_hds(hdsloc, self.head)
-                hdsloc.annul()
-
-            ndf.end()
-        except:
-            ndf.end()
-            raise
-
-def _read_hds(loc, head, array=False):
-    """Recursive reader of an HDS starting from locator = loc"""
+        self._indf = ndf.open(fname)
 
-    name = loc.name()
-    if loc.struc():
-        dims = loc.shape()
-        if dims != None:
-            head[name] = _create_md_struc(dims)
-            sub = n.zeros(dims.size, int)
-            _read_md_struc(head[name], loc, dims, sub)
-        else:
-            if array:
-                h = head
-            else:
-                h = head[name] = {}
-            ncomp = loc.ncomp()
-            for ncmp in range(ncomp):
+    def close(self):
+        """
+        Releases the NDF. Attributes which have already been read remain
+        available but no others can be.
+        """
+        self._indf.annul()
+
+    @lazy
+    def data(self):
+        return self._indf.read('Dat')
+
+    @lazy
+    def var(self):
+        return self._indf.read('Var')
+
+    @lazy
+    def bound(self):
+        return self._indf.bound()
+
+    @lazy
+    def label(self):
+        return self._indf.cget('Label')
+
+    @lazy
+    def title(self):
+        return self._indf.cget('Title')
+
+    @lazy
+    def units(self):
+        return self._indf.cget('Units')
+
+    @lazy
+    def axes(self):
+        return [Axis(self._indf, nax) for nax in range(len(self._indf.dim()))]
+
+    @lazy
+    def head(self):
+        locs = []
+        nextn = self._indf.xnumb()
+        for nex in range(nextn):
+            xname = self._indf.xname(nex)
+            locs.append((xname, hds._transfer(self._indf.xloc(xname, 'READ'))))
+        return HdsMapping(locs)
+
+class HdsMapping(Mapping):
+    """
+    Read-only dictionary-like view of an HDS structure, keyed by component
+    name. Nothing is read until a component is looked up, when primitives
+    are returned as by the get method of an HDS locator, scalar structures
+    as further HdsMappings and arrays of structures as nested lists of
+    HdsMappings. Values are kept once read, as are the locators, so that
+    repeated lookups cost nothing. Undefined primitives are left out, as
+    they are by todict.
+    """
+
+    def __init__(self, locs):
+        """
+        Initialise from a sequence of (name, locator) pairs or from the
+        locator of a scalar structure, whose components are then used.
+        """
+        if isinstance(locs, hds.api):
+            loc  = locs
+            locs = []
+            for ncmp in range(loc.ncomp()):
                 loc1 = loc.index(ncmp)
-                _read_hds(loc1, h, array)
-                loc1.annul()
-    elif loc.state():
-        head[name] = loc.get()
-
-def _create_md_struc(dims):
-    """Creates a multi-dimensional list of dictionaries to represent multi-dimensional structures"""
-    if len(dims) > 1:
-        ndims = dims[1:]
-        return [_create_md_struc(ndims) for i in range(dims[0])]
-    else:
-        return [{} for i in range(dims[0])]
-
-def _read_md_struc(mds, loc, dims, sub):
-    """Recursive reader of a structure array pointed to by loc. sub must start at (0,0,...,0)"""
-    if isinstance(mds, list):
-        for mdst in mds:
-            _read_md_struc(mdst, loc, dims, sub)
-    else:
-        loc1 = loc.cell(sub)
-        _read_hds(loc1, mds, True)
-        loc1.annul()
-
-        # update index array for next element
-        sub[-1] += 1
-        for i in range(len(sub)-1,0,-1):
-            if sub[i] == dims[i]:
-                sub[i]    = 0
-                sub[i-1] += 1
+                locs.append((loc1.name(), loc1))
+        self._locs  = OrderedDict((name, loc) for name, loc in locs
+                                  if loc.struc() or loc.state())
+        self._cache = {}
 
+    def __getitem__(self, key):
+        if key not in self._cache:
+            self._cache[key] = _hds_value(self._locs[key])
+        return self._cache[key]
+
+    def __iter__(self):
+        return iter(self._locs)
+
+    def __len__(self):
+        return len(self._locs)
+
+    def todict(self):
+        """
+        Reads every component in one go, returning an ordinary dictionary
+        with structures as nested dictionaries and arrays of structures as
+        nested lists of dictionaries.
+        """
+        head = {}
+        for loc in self._locs.values():
+            _read_hds(loc, head)
+        return head
+
+    def __repr__(self):
+        return 'HdsMapping(' + repr(list(self._locs)) + ')'
+
+def _hds_value(loc):
+    """Returns the value of the HDS component at locator loc for an HdsMapping"""
+    if loc.struc():
+        dims = loc.shape()
+        if dims is None:
+            return HdsMapping(loc)
+        return _cell_mappings(loc, dims, [])
+    return loc.get()
+
+def _cell_mappings(loc, dims, sub):
+    """Builds nested lists of HdsMappings over the cells of a structure array"""
+    if len(sub) == len(dims) - 1:
+        return [HdsMapping(loc.cell(sub + [i])) for i in range(dims[len(sub)])]
+    return [_cell_mappings(loc, dims, sub + [i]) for i in range(dims[len(sub)])]
+
+def _read_hds(loc, head):
+    """Recursive reader of an HDS starting from locator = loc"""
+    head.update(loc.tree())
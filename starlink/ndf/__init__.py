@@ -12,11 +12,12 @@ import starlink.ndf
 ndf = starlink.ndf.Ndf('image')
 
 See documentation on the Ndf class for how to access the various components.
-Ndf is the main class and reads in entire Ndf files in a recursive manner.  In
-the above example, ndf.data would contain the main data, ndf.head would
-contain extension information (that can be extensive). This could cause memory
-problems with very large files, but should at least allow fairly complete
-access to all NDF components. The module also enables access to low-level
+Ndf is the main class and gives access to entire Ndf files, reading each
+component the first time it is used.  In the above example, ndf.data would
+contain the main data, ndf.head would contain extension information (that can
+be extensive, and is read recursively). This could cause memory problems with
+very large files, but should at least allow fairly complete access to all NDF
+components. The module also enables access to low-level
 functions to access ndf components. Only use these if you are familiar with
 the standard ndf library. You may need a little bit of knowledge of NDF to be
 fully confident with aspects of this module.
@@ -24,8 +25,14 @@ fully confident with aspects of this module.
 Classes
 =======
 
-Axis    -- represents an NDF Axis component
-Ndf     -- represents Starlink NDF files
+Appender -- writes frames one after another into a growing NDF
+Axis     -- represents an NDF Axis component
+Ndf      -- represents Starlink NDF files
+
+Modules
+=======
+
+catalog -- on-disk catalogue of the metadata of directories of NDFs
 
 Functions
 =========
@@ -0,0 +1,296 @@
+"""
+On-disk catalogue of NDF metadata
+
+A Catalog keeps the metadata of the NDFs in a set of directories in an
+SQLite database, so that frames can be found by shape, title or FITS
+keyword without opening every file again. For instance
+
+import starlink.ndf.catalog as catalog
+
+cat = catalog.Catalog('night.db', keywords=['OBJECT','EXPTIME'])
+cat.update('/data/20111012')
+paths = cat.find(shape=(1024,1024), OBJECT='M31')
+
+Each update only rescans files whose modification time or size has
+changed since they were last seen, and forgets files that have gone.
+Files are read with ndf.info and, for keywords, the FITS extension,
+spread across several worker processes.
+"""
+
+import starlink.ndf.api as ndf
+import starlink.hds.api as hds
+
+import os
+import fnmatch
+import sqlite3
+import multiprocessing
+
+_SCHEMA = """
+CREATE TABLE IF NOT EXISTS meta (
+    key   TEXT PRIMARY KEY,
+    value TEXT
+);
+CREATE TABLE IF NOT EXISTS files (
+    path       TEXT PRIMARY KEY,
+    mtime      REAL,
+    size       INTEGER,
+    ndim       INTEGER,
+    shape      TEXT,
+    lbnd       TEXT,
+    ubnd       TEXT,
+    type       TEXT,
+    title      TEXT,
+    label      TEXT,
+    units      TEXT,
+    extensions TEXT,
+    bad        INTEGER,
+    error      TEXT
+);
+CREATE TABLE IF NOT EXISTS keywords (
+    path   TEXT,
+    name   TEXT,
+    value  TEXT,
+    number REAL,
+    PRIMARY KEY (path, name)
+);
+CREATE INDEX IF NOT EXISTS keywords_value ON keywords (name, value);
+CREATE INDEX IF NOT EXISTS keywords_number ON keywords (name, number);
+CREATE INDEX IF NOT EXISTS files_shape ON files (shape);
+"""
+
+_FIELDS = ('ndim', 'shape', 'lbnd', 'ubnd', 'type', 'title', 'label', 'units',
+           'extensions', 'bad', 'error')
+
+class Catalog(object):
+    """
+    Catalogue of NDF metadata held in an SQLite database.
+
+    The following are recorded for each file: path, mtime, size, ndim,
+    shape, lbnd, ubnd (comma-separated, C order), type, title, label,
+    units, extensions (comma-separated), bad (bad pixel flag) and error
+    (the message if the file could not be read). The values of the
+    selected FITS keywords are recorded too, as text and, where they can
+    be read as such, as numbers.
+    """
+
+    def __init__(self, dbname, keywords=()):
+        """
+        Opens the catalogue in file dbname, creating it if need be.
+
+        keywords -- names of FITS keywords to record. If these differ from
+                    those the catalogue was last updated with, every file
+                    is rescanned at the next update.
+        """
+        self.db = sqlite3.connect(dbname)
+        self.db.executescript(_SCHEMA)
+        self.keywords = [key.upper() for key in keywords]
+
+        row = self.db.execute("SELECT value FROM meta WHERE key='keywords'").fetchone()
+        keys = ','.join(self.keywords)
+        if row is None or row[0] != keys:
+            with self.db:
+                self.db.execute("UPDATE files SET mtime=-1")
+                self.db.execute("INSERT OR REPLACE INTO meta VALUES ('keywords', ?)", (keys,))
+
+    def close(self):
+        """Closes the database."""
+        self.db.close()
+
+    def update(self, directory, pattern='*.sdf', recursive=False, processes=None):
+        """
+        Brings the catalogue up to date with the NDFs in a directory,
+        rescanning only those files which are new or whose modification
+        time or size has changed and dropping any that have gone.
+
+        directory -- directory to scan
+        pattern   -- files to consider, a shell-style pattern
+        recursive -- look in subdirectories too
+        processes -- number of worker processes, by default one per CPU.
+                     1 scans in this process.
+
+        Returns the numbers of files scanned and removed.
+        """
+        directory = os.path.abspath(directory)
+        found = {}
+        for dirpath, dirnames, filenames in os.walk(directory):
+            for fname in fnmatch.filter(filenames, pattern):
+                path = os.path.join(dirpath, fname)
+                try:
+                    st = os.stat(path)
+                except OSError:
+                    continue
+                found[path] = (st.st_mtime, st.st_size)
+            if not recursive:
+                break
+
+        # Compare against what is there already
+        known = {}
+        prefix = os.path.join(directory, '')
+        for path, mtime, size in self.db.execute(
+                "SELECT path, mtime, size FROM files WHERE substr(path, 1, ?) = ?",
+                (len(prefix), prefix)):
+            if recursive or os.path.dirname(path) == directory:
+                known[path] = (mtime, size)
+        gone = [path for path in known if path not in found]
+        todo = [(path, found[path][0], found[path][1]) for path in found
+                if known.get(path) != found[path]]
+
+        with self.db:
+            for path in gone:
+                self._remove(path)
+
+            if processes == 1 or len(todo) < 2:
+                results = (_scan(args, self.keywords) for args in todo)
+                self._store(results)
+            else:
+                pool = multiprocessing.Pool(processes, _init_worker, (self.keywords,))
+                try:
+                    self._store(pool.imap_unordered(_scan_worker, todo, 16))
+                finally:
+                    pool.close()
+                    pool.join()
+
+        return len(todo), len(gone)
+
+    def find(self, shape=None, title=None, type=None, **keywords):
+        """
+        Returns the paths of the files matching all the criteria given,
+        sorted by name.
+
+        shape    -- dimensions (C order) as a sequence
+        title    -- title, with SQL LIKE wildcards (% and _) allowed
+        type     -- data type, e.g. '_REAL'
+        keywords -- FITS keyword values, e.g. OBJECT='M31'. Numbers are
+                    compared as numbers, anything else as text.
+        """
+        where, params = [], []
+        if shape is not None:
+            where.append("f.shape = ?")
+            params.append(','.join(str(d) for d in shape))
+        if title is not None:
+            where.append("f.title LIKE ?")
+            params.append(title)
+        if type is not None:
+            where.append("f.type = ?")
+            params.append(type)
+        for key, value in keywords.items():
+            column = 'number' if isinstance(value, (int, float)) else 'value'
+            where.append("EXISTS (SELECT 1 FROM keywords k WHERE k.path = f.path"
+                         " AND k.name = ? AND k." + column + " = ?)")
+            params.extend([key.upper(), value])
+
+        sql = "SELECT f.path FROM files f"
+        if where:
+            sql += " WHERE " + " AND ".join(where)
+        sql += " ORDER BY f.path"
+        return [row[0] for row in self.db.execute(sql, params)]
+
+    def info(self, path):
+        """
+        Returns the recorded metadata of a file as a dictionary, with the
+        keywords in a dictionary of their own, or None if it is unknown.
+        """
+        path = os.path.abspath(path)
+        row = self.db.execute("SELECT " + ','.join(_FIELDS) + " FROM files WHERE path = ?",
+                              (path,)).fetchone()
+        if row is None:
+            return None
+        info = dict(zip(_FIELDS, row))
+        info['keywords'] = dict(self.db.execute(
+            "SELECT name, value FROM keywords WHERE path = ?", (path,)))
+        return info
+
+    def query(self, sql, params=()):
+        """Runs an SQL query on the catalogue, returning all the rows."""
+        return self.db.execute(sql, params).fetchall()
+
+    def _remove(self, path):
+        self.db.execute("DELETE FROM files WHERE path = ?", (path,))
+        self.db.execute("DELETE FROM keywords WHERE path = ?", (path,))
+
+    def _store(self, results):
+        for path, mtime, size, fields, cards in results:
+            self._remove(path)
+            self.db.execute("INSERT INTO files VALUES (?,?,?" + ",?"*len(_FIELDS) + ")",
+                            (path, mtime, size) + fields)
+            self.db.executemany("INSERT INTO keywords VALUES (?,?,?,?)",
+                                [(path,) + card for card in cards])
+
+# Worker side. The keywords are passed once to each worker process rather
+# than with every file.
+
+_keywords = ()
+
+def _init_worker(keywords):
+    global _keywords
+    _keywords = keywords
+
+def _scan_worker(args):
+    return _scan(args, _keywords)
+
+def _scan(args, keywords):
+    """
+    Reads the metadata of one file, returning (path, mtime, size, fields,
+    cards) where fields match _FIELDS and cards is a list of (name, value,
+    number) for the keywords wanted. Failures are recorded, not raised.
+    """
+    path, mtime, size = args
+    try:
+        info = ndf.info(path)
+        fields = (len(info.shape),
+                  ','.join(str(d) for d in info.shape),
+                  ','.join(str(b) for b in info.bound[0]),
+                  ','.join(str(b) for b in info.bound[1]),
+                  info.type, info.title, info.label, info.units,
+                  ','.join(info.extensions), int(info.bad), None)
+        cards = []
+        if keywords and 'FITS' in info.extensions:
+            cards = _read_keywords(path, keywords)
+    except Exception as err:
+        fields = (None,)*(len(_FIELDS)-1) + (str(err),)
+        cards = []
+    return path, mtime, size, fields, cards
+
+def _read_keywords(path, keywords):
+    """Returns (name, value, number) for each of keywords found in the FITS extension."""
+    indf = ndf.open(path)
+    loc = hds._transfer(indf.xloc('FITS', 'READ'))
+    try:
+        header = loc.get()
+    finally:
+        loc.annul()
+        indf.annul()
+
+    cards = []
+    wanted = set(keywords)
+    for card in header.ravel():
+        if isinstance(card, bytes):
+            card = card.decode('ascii', 'replace')
+        name = card[:8].strip()
+        if name in wanted and card[8:10] == '= ':
+            wanted.discard(name)
+            value = _card_value(card[10:])
+            try:
+                number = float(value)
+            except ValueError:
+                number = None
+            cards.append((name, value, number))
+    return cards
+
+def _card_value(field):
+    """Extracts the value from the value/comment field of a FITS card"""
+    field = field.strip()
+    if field.startswith("'"):
+        # strings are quoted, with '' standing for a quote
+        value, i = '', 1
+        while i < len(field):
+            if field[i] == "'":
+                if field[i+1:i+2] == "'":
+                    value += "'"
+                    i += 2
+                    continue
+                break
+            value += field[i]
+            i += 1
+        return value.rstrip()
+    return field.split('/')[0].strip()
@@ -0,0 +1,776 @@
+//
+// Numerical kernels used by the NDF interface
+
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+//
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "kernels.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Bad value <-> NaN translation. The SSE2 versions handle four floats
+// or two doubles at a time by building a mask of the elements to be
+// replaced and selecting between the input and the replacement with it.
+// Whatever is left over, or everything on other hardware, is done by the
+// scalar loops, which are written so that the compiler can vectorise them.
+
+void bad2nan_f(const float *in, float *out, size_t n, float bad)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128 vbad = _mm_set1_ps(bad);
+    const __m128 vnan = _mm_set1_ps(NAN);
+    for(; i+4 <= n; i += 4){
+	__m128 v = _mm_loadu_ps(in+i);
+	__m128 m = _mm_cmpeq_ps(v, vbad);
+	_mm_storeu_ps(out+i, _mm_or_ps(_mm_and_ps(m, vnan), _mm_andnot_ps(m, v)));
+    }
+#endif
+    for(; i<n; i++){
+	float v = in[i];
+	out[i] = v == bad ? NAN : v;
+    }
+}
+
+void bad2nan_d(const double *in, double *out, size_t n, double bad)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128d vbad = _mm_set1_pd(bad);
+    const __m128d vnan = _mm_set1_pd(NAN);
+    for(; i+2 <= n; i += 2){
+	__m128d v = _mm_loadu_pd(in+i);
+	__m128d m = _mm_cmpeq_pd(v, vbad);
+	_mm_storeu_pd(out+i, _mm_or_pd(_mm_and_pd(m, vnan), _mm_andnot_pd(m, v)));
+    }
+#endif
+    for(; i<n; i++){
+	double v = in[i];
+	out[i] = v == bad ? NAN : v;
+    }
+}
+
+void nan2bad_f(const float *in, float *out, size_t n, float bad)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128 vbad = _mm_set1_ps(bad);
+    for(; i+4 <= n; i += 4){
+	__m128 v = _mm_loadu_ps(in+i);
+	__m128 m = _mm_cmpunord_ps(v, v);
+	_mm_storeu_ps(out+i, _mm_or_ps(_mm_and_ps(m, vbad), _mm_andnot_ps(m, v)));
+    }
+#endif
+    for(; i<n; i++){
+	float v = in[i];
+	out[i] = v != v ? bad : v;
+    }
+}
+
+void nan2bad_d(const double *in, double *out, size_t n, double bad)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128d vbad = _mm_set1_pd(bad);
+    for(; i+2 <= n; i += 2){
+	__m128d v = _mm_loadu_pd(in+i);
+	__m128d m = _mm_cmpunord_pd(v, v);
+	_mm_storeu_pd(out+i, _mm_or_pd(_mm_and_pd(m, vbad), _mm_andnot_pd(m, v)));
+    }
+#endif
+    for(; i<n; i++){
+	double v = in[i];
+	out[i] = v != v ? bad : v;
+    }
+}
+
+// Block binning. The chunk is worked through a row (of the last axis) at
+// a time, each row split into the runs of pixels that fall in the same
+// output pixel so that the inner loops are simple sums or maxima.
+
+#define BIN_CHUNK(NAME, TYPE) \
+void NAME(const TYPE *in, TYPE bad, int ndim, const size_t *cdim, \
+	  const size_t *coff, const size_t *fac, const size_t *odim, \
+	  int method, double *acc, size_t *count) \
+{ \
+    size_t idx[BIN_MXDIM] = {0}; \
+    size_t i, r, x, o, end, nok, nrow = 1; \
+    int k, last = ndim-1; \
+    const size_t nx = cdim[last], fx = fac[last], cx = coff[last]; \
+    for(k=0; k<last; k++) nrow *= cdim[k]; \
+    for(r=0; r<nrow; r++, in += nx){ \
+	size_t base = 0; \
+	for(k=0; k<last; k++) base = base*odim[k] + (coff[k]+idx[k])/fac[k]; \
+	base *= odim[last]; \
+	for(x=0; x<nx; x=end){ \
+	    o = (cx+x)/fx; \
+	    end = (o+1)*fx - cx; \
+	    if(end > nx) end = nx; \
+	    o += base; \
+	    nok = 0; \
+	    if(method == BIN_MAX){ \
+		double m = 0.; \
+		for(i=x; i<end; i++){ \
+		    TYPE v = in[i]; \
+		    if(v == bad || v != v) continue; \
+		    if(nok++ == 0 || v > m) m = v; \
+		} \
+		if(nok && (count[o] == 0 || m > acc[o])) acc[o] = m; \
+	    }else{ \
+		double sum = 0.; \
+		for(i=x; i<end; i++){ \
+		    TYPE v = in[i]; \
+		    if(v == bad || v != v) continue; \
+		    sum += v; \
+		    nok++; \
+		} \
+		acc[o] += sum; \
+	    } \
+	    count[o] += nok; \
+	} \
+	for(k=last-1; k>=0; k--){ \
+	    if(++idx[k] < cdim[k]) break; \
+	    idx[k] = 0; \
+	} \
+    } \
+}
+
+BIN_CHUNK(bin_chunk_f, float)
+BIN_CHUNK(bin_chunk_d, double)
+
+void bin_finish(int method, double *acc, const size_t *count, size_t n)
+{
+    size_t i;
+    for(i=0; i<n; i++){
+	if(count[i] == 0)
+	    acc[i] = NAN;
+	else if(method == BIN_MEAN)
+	    acc[i] /= count[i];
+    }
+}
+
+// Statistics
+
+void stat_merge(stat_acc *a, const stat_acc *b)
+{
+    if(b->n == 0.) return;
+    if(a->n == 0.){
+	*a = *b;
+	return;
+    }
+    double n = a->n + b->n, d = b->mean - a->mean;
+    a->mean += d*b->n/n;
+    a->m2 += b->m2 + d*d*a->n*b->n/n;
+    if(b->min < a->min) a->min = b->min;
+    if(b->max > a->max) a->max = b->max;
+    a->n = n;
+}
+
+// values per block of the two-pass accumulation: 32kB of doubles
+#define STAT_BLOCK 4096
+
+// rows per thread below which it is not worth starting more threads
+#define STAT_MINPIX 65536
+
+// A share of the rows of a chunk. acc holds the accumulators lo to hi,
+// which is all those its rows touch.
+
+typedef struct {
+    const void *in;
+    int dbl;
+    double bad;
+    int ndim, axis;
+    const size_t *cdim, *coff, *dim;
+    size_t r0, r1, lo, hi;
+    stat_acc *acc;
+} stat_job;
+
+// The index of the accumulator of the start of the row with chunk
+// indices idx
+
+static size_t stat_base(const stat_job *job, const size_t *idx)
+{
+    int k, last = job->ndim-1;
+    size_t base = 0;
+    if(job->axis < 0) return 0;
+    for(k=0; k<last; k++)
+	if(k != job->axis) base = base*job->dim[k] + job->coff[k] + idx[k];
+    if(job->axis != last) base = base*job->dim[last] + job->coff[last];
+    return base;
+}
+
+// The chunk indices of the start of row r
+
+static void stat_index(const stat_job *job, size_t r, size_t *idx)
+{
+    int k;
+    for(k=job->ndim-2; k>=0; k--){
+	idx[k] = r % job->cdim[k];
+	r /= job->cdim[k];
+    }
+}
+
+// The rows r0 to r1 of the chunk. A row which reduces to one accumulator
+// is taken a block at a time: the first pass finds the count, sum and
+// extremes, the second the squared deviations from the block's mean, and
+// the block is then merged in. Otherwise each value of the row goes to
+// its own accumulator by Welford's update.
+
+#define STAT_ROWS(NAME, TYPE) \
+static void NAME(const stat_job *job) \
+{ \
+    size_t idx[BIN_MXDIM] = {0}; \
+    size_t i, r, x, end, n; \
+    int k, last = job->ndim-1, axis = job->axis; \
+    const size_t *cdim = job->cdim; \
+    const size_t nx = cdim[last]; \
+    const TYPE bad = (TYPE)job->bad; \
+    const TYPE *in = (const TYPE *)job->in + job->r0*nx; \
+    stat_index(job, job->r0, idx); \
+    for(r=job->r0; r<job->r1; r++, in += nx){ \
+	stat_acc *acc = job->acc + (stat_base(job, idx) - job->lo); \
+	if(axis < 0 || axis == last){ \
+	    for(x=0; x<nx; x=end){ \
+		end = x + STAT_BLOCK < nx ? x + STAT_BLOCK : nx; \
+		stat_acc blk; \
+		double sum = 0., m2 = 0., mn = INFINITY, mx = -INFINITY; \
+		n = 0; \
+		for(i=x; i<end; i++){ \
+		    TYPE v = in[i]; \
+		    if(v == bad || v != v) continue; \
+		    sum += v; \
+		    if(v < mn) mn = v; \
+		    if(v > mx) mx = v; \
+		    n++; \
+		} \
+		if(n == 0) continue; \
+		blk.n = n; \
+		blk.mean = sum/n; \
+		for(i=x; i<end; i++){ \
+		    TYPE v = in[i]; \
+		    if(v == bad || v != v) continue; \
+		    double d = v - blk.mean; \
+		    m2 += d*d; \
+		} \
+		blk.m2 = m2; \
+		blk.min = mn; \
+		blk.max = mx; \
+		stat_merge(acc, &blk); \
+	    } \
+	}else{ \
+	    for(x=0; x<nx; x++){ \
+		TYPE v = in[x]; \
+		if(v == bad || v != v) continue; \
+		stat_acc *a = acc + x; \
+		double d = v - a->mean; \
+		a->n += 1.; \
+		a->mean += d/a->n; \
+		a->m2 += d*(v - a->mean); \
+		if(a->n == 1. || v < a->min) a->min = v; \
+		if(a->n == 1. || v > a->max) a->max = v; \
+	    } \
+	} \
+	for(k=last-1; k>=0; k--){ \
+	    if(++idx[k] < cdim[k]) break; \
+	    idx[k] = 0; \
+	} \
+    } \
+}
+
+STAT_ROWS(stat_rows_f, float)
+STAT_ROWS(stat_rows_d, double)
+
+static void stat_thread(stat_job *job)
+{
+    if(job->dbl)
+	stat_rows_d(job);
+    else
+	stat_rows_f(job);
+}
+
+// The range of accumulators touched by the rows of a job. Rows along the
+// last axis each have their own, in order; otherwise they are found row
+// by row.
+
+static void stat_range(stat_job *job)
+{
+    size_t idx[BIN_MXDIM] = {0}, r, base;
+    int k, last = job->ndim-1;
+    job->lo = job->hi = 0;
+    if(job->axis < 0) return;
+    stat_index(job, job->r0, idx);
+    job->lo = job->hi = stat_base(job, idx);
+    if(job->axis == last){
+	stat_index(job, job->r1-1, idx);
+	job->hi = stat_base(job, idx);
+	return;
+    }
+    for(r=job->r0+1; r<job->r1; r++){
+	for(k=last-1; k>=0; k--){
+	    if(++idx[k] < job->cdim[k]) break;
+	    idx[k] = 0;
+	}
+	base = stat_base(job, idx);
+	if(base < job->lo) job->lo = base;
+	if(base > job->hi) job->hi = base;
+    }
+    job->hi += job->cdim[last] - 1;
+}
+
+// A pool of worker threads, kept for as long as a whole array is being
+// streamed. Each chunk's jobs are handed out through next; the caller
+// works on them too, so the pool may have fewer threads than asked for.
+
+struct stat_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t go, done;
+    unsigned long gen;
+    int nthread, nworker, active, quit, next, njob;
+    stat_job *jobs;
+    pthread_t workers[];
+};
+
+// Works on jobs until there are none left; called with the lock held
+
+static void stat_pool_work(stat_pool *pool)
+{
+    while(pool->next < pool->njob){
+	stat_job *job = pool->jobs + pool->next++;
+	pthread_mutex_unlock(&pool->lock);
+	stat_thread(job);
+	pthread_mutex_lock(&pool->lock);
+    }
+}
+
+static void *stat_worker(void *arg)
+{
+    stat_pool *pool = (stat_pool *)arg;
+    unsigned long seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    for(;;){
+	while(!pool->quit && pool->gen == seen)
+	    pthread_cond_wait(&pool->go, &pool->lock);
+	if(pool->quit) break;
+	seen = pool->gen;
+	stat_pool_work(pool);
+	if(--pool->active == 0) pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+stat_pool *stat_pool_new(int nthread)
+{
+    if(nthread < 1) nthread = 1;
+    stat_pool *pool = malloc(sizeof(stat_pool) + nthread*sizeof(pthread_t));
+    if(pool == NULL) return NULL;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->go, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->gen = 0;
+    pool->nthread = nthread;
+    pool->active = pool->quit = pool->next = pool->njob = 0;
+    pool->jobs = NULL;
+    for(pool->nworker=0; pool->nworker<nthread-1; pool->nworker++)
+	if(pthread_create(pool->workers + pool->nworker, NULL, stat_worker, pool) != 0) break;
+    return pool;
+}
+
+void stat_pool_free(stat_pool *pool)
+{
+    int t;
+    if(pool == NULL) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->go);
+    pthread_mutex_unlock(&pool->lock);
+    for(t=0; t<pool->nworker; t++) pthread_join(pool->workers[t], NULL);
+    pthread_cond_destroy(&pool->go);
+    pthread_cond_destroy(&pool->done);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+// The rows are shared out in contiguous runs. A share whose accumulators
+// no other share touches (as when rows along the last axis each have
+// their own), and the first share, work on acc directly; the others on
+// private copies of just the range they touch, merged in once all are
+// done. Returns 0, or -1 if memory ran out (acc is then unchanged).
+
+int stat_chunk(const void *in, int dbl, double bad, int ndim, const size_t *cdim,
+	       const size_t *coff, const size_t *dim, int axis, stat_pool *pool,
+	       stat_acc *acc)
+{
+    size_t i, nrow = 1, npix, npriv = 0;
+    int k, t, u, nt;
+    for(k=0; k<ndim-1; k++) nrow *= cdim[k];
+    npix = nrow*cdim[ndim-1];
+
+    nt = pool ? pool->nthread : 1;
+    if((size_t)nt > nrow) nt = nrow;
+    if((size_t)nt > npix/STAT_MINPIX) nt = npix/STAT_MINPIX;
+    if(nt < 1) nt = 1;
+
+    stat_job jobs[nt];
+    int direct[nt];
+    stat_acc *priv = NULL;
+    for(t=0; t<nt; t++){
+	stat_job *job = jobs + t;
+	job->in = in;
+	job->dbl = dbl;
+	job->bad = bad;
+	job->ndim = ndim;
+	job->axis = axis;
+	job->cdim = cdim;
+	job->coff = coff;
+	job->dim = dim;
+	job->r0 = nrow*t/nt;
+	job->r1 = nrow*(t+1)/nt;
+	stat_range(job);
+    }
+    for(t=0; t<nt; t++){
+	direct[t] = 1;
+	for(u=0; t>0 && u<nt; u++)
+	    if(u != t && jobs[u].lo <= jobs[t].hi && jobs[t].lo <= jobs[u].hi) direct[t] = 0;
+	if(!direct[t]) npriv += jobs[t].hi - jobs[t].lo + 1;
+    }
+    if(npriv > 0){
+	priv = calloc(npriv, sizeof(stat_acc));
+	if(priv == NULL) return -1;
+    }
+    for(t=0, npriv=0; t<nt; t++){
+	if(direct[t]){
+	    jobs[t].acc = acc + jobs[t].lo;
+	}else{
+	    jobs[t].acc = priv + npriv;
+	    npriv += jobs[t].hi - jobs[t].lo + 1;
+	}
+    }
+
+    // run the first share here and hand the rest to the pool, helping
+    // with them once it is done
+    if(nt > 1){
+	pthread_mutex_lock(&pool->lock);
+	pool->jobs = jobs;
+	pool->njob = nt;
+	pool->next = 1;
+	pool->active = pool->nworker;
+	pool->gen++;
+	pthread_cond_broadcast(&pool->go);
+	pthread_mutex_unlock(&pool->lock);
+    }
+    stat_thread(jobs);
+    if(nt > 1){
+	pthread_mutex_lock(&pool->lock);
+	stat_pool_work(pool);
+	while(pool->active > 0)
+	    pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+    }
+
+    for(t=1; t<nt; t++)
+	if(!direct[t])
+	    for(i=jobs[t].lo; i<=jobs[t].hi; i++) stat_merge(acc+i, jobs[t].acc+(i-jobs[t].lo));
+    free(priv);
+    return 0;
+}
+
+// Histograms
+
+#define HIST_LOOP(TYPE) \
+    { \
+	const TYPE *v = (const TYPE *)in, b = (TYPE)bad; \
+	for(i=0; i<n; i++){ \
+	    TYPE x = v[i]; \
+	    if(x == b || x != x || x < lo || x > hi) continue; \
+	    size_t j = (size_t)((x - lo)*scale); \
+	    counts[j < nbin ? j : nbin-1]++; \
+	} \
+    }
+
+void hist_chunk(const void *in, int dbl, double bad, size_t n, double lo,
+		double hi, size_t nbin, unsigned long long *counts)
+{
+    size_t i;
+    const double scale = nbin/(hi - lo);
+    if(dbl)
+	HIST_LOOP(double)
+    else
+	HIST_LOOP(float)
+}
+
+// Quantile sketches
+
+// smallest capacity of a level, and of the bottom level, which is
+// filled straight from the data and so is made big enough for the
+// compactions of it to be worth their sorts
+#define KLL_MINCAP 8
+#define KLL_BUFFER 1024
+
+static size_t kll_cap(const kll_sketch *sk, int level)
+{
+    double c = ceil(sk->k*pow(2./3., sk->nlev - 1 - level));
+    size_t min = level ? KLL_MINCAP : KLL_BUFFER;
+    return c > min ? (size_t)c : min;
+}
+
+static int kll_reserve(kll_sketch *sk, int level, size_t n)
+{
+    if(sk->len[level] + n <= sk->alloc[level]) return 0;
+    size_t alloc = 2*sk->alloc[level];
+    if(alloc < sk->len[level] + n) alloc = sk->len[level] + n;
+    double *items = realloc(sk->items[level], alloc*sizeof(double));
+    if(items == NULL) return -1;
+    sk->items[level] = items;
+    sk->alloc[level] = alloc;
+    return 0;
+}
+
+// Sorts n doubles: quicksort on the median of three down to short runs,
+// which are left for a final insertion sort. Much quicker than qsort,
+// which the bottom level would otherwise spend most of its time in.
+static void kll_sort(double *a, size_t n)
+{
+    size_t stack[2*64], top = 0, lo = 0, hi = n, i, j;
+    for(;;){
+	while(hi - lo > 16){
+	    size_t mid = lo + (hi - lo)/2;
+	    double x = a[lo], y = a[mid], z = a[hi-1], t;
+	    double pivot = x < y ? (y < z ? y : (x < z ? z : x)) : (x < z ? x : (y < z ? z : y));
+	    i = lo;
+	    j = hi - 1;
+	    for(;;){
+		while(a[i] < pivot) i++;
+		while(a[j] > pivot) j--;
+		if(i >= j) break;
+		t = a[i]; a[i] = a[j]; a[j] = t;
+		i++;
+		j--;
+	    }
+	    // push the larger part, carry on with the smaller
+	    if(j + 1 - lo > hi - j - 1){
+		stack[top++] = lo;
+		stack[top++] = j + 1;
+		lo = j + 1;
+	    }else{
+		stack[top++] = j + 1;
+		stack[top++] = hi;
+		hi = j + 1;
+	    }
+	}
+	if(top == 0) break;
+	hi = stack[--top];
+	lo = stack[--top];
+    }
+    for(i=1; i<n; i++){
+	double v = a[i];
+	for(j=i; j>0 && a[j-1] > v; j--) a[j] = a[j-1];
+	a[j] = v;
+    }
+}
+
+// Sorts a level and promotes every other item, leaving one behind if
+// there is an odd number.
+static int kll_compact(kll_sketch *sk, int level)
+{
+    size_t i, len = sk->len[level], half = len/2;
+    double *items = sk->items[level];
+    if(level+1 >= KLL_MXLEV) return 0;
+    if(kll_reserve(sk, level+1, half) < 0) return -1;
+    if(level+1 == sk->nlev) sk->nlev++;
+    kll_sort(items, len);
+
+    // xorshift64 for the random offset
+    sk->seed ^= sk->seed << 13;
+    sk->seed ^= sk->seed >> 7;
+    sk->seed ^= sk->seed << 17;
+    size_t off = (len & 1) + (sk->seed & 1);
+
+    double *up = sk->items[level+1] + sk->len[level+1];
+    for(i=0; i<half; i++) up[i] = items[off + 2*i];
+    sk->len[level+1] += half;
+    sk->len[level] = len & 1;
+    return 0;
+}
+
+// Number of items which can be added before the sketch is over its
+// total capacity, which may be negative.
+static long long kll_room(const kll_sketch *sk, const size_t *cap)
+{
+    int h;
+    long long room = 0;
+    for(h=0; h<sk->nlev; h++)
+	room += (long long)cap[h] - (long long)sk->len[h];
+    return room;
+}
+
+static void kll_caps(const kll_sketch *sk, size_t *cap)
+{
+    int h;
+    for(h=0; h<sk->nlev; h++) cap[h] = kll_cap(sk, h);
+}
+
+// Compacts levels, lowest first, until the items fit the total capacity.
+// Returns the room left, or -1 if memory ran out.
+static long long kll_compress(kll_sketch *sk)
+{
+    size_t cap[KLL_MXLEV];
+    long long room;
+    kll_caps(sk, cap);
+    while((room = kll_room(sk, cap)) < 0){
+	int h, nlev = sk->nlev;
+	for(h=0; h<nlev; h++)
+	    if(sk->len[h] >= cap[h]) break;
+	if(h == nlev || h+1 >= KLL_MXLEV) return 0;
+	if(kll_compact(sk, h) < 0) return -1;
+	if(sk->nlev != nlev) kll_caps(sk, cap);
+    }
+    return room;
+}
+
+void kll_init(kll_sketch *sk, int k)
+{
+    memset(sk, 0, sizeof(kll_sketch));
+    sk->k = k;
+    sk->nlev = 1;
+    sk->min = INFINITY;
+    sk->max = -INFINITY;
+    sk->seed = 0x9e3779b97f4a7c15ULL;
+}
+
+void kll_free(kll_sketch *sk)
+{
+    int h;
+    for(h=0; h<KLL_MXLEV; h++){
+	free(sk->items[h]);
+	sk->items[h] = NULL;
+	sk->len[h] = sk->alloc[h] = 0;
+    }
+}
+
+// The good values are copied into the bottom level in runs which take up
+// the room left in the sketch, compressing in between.
+#define KLL_LOOP(TYPE) \
+    { \
+	const TYPE *v = (const TYPE *)in, b = (TYPE)bad; \
+	long long slack = kll_compress(sk); \
+	while(i < n){ \
+	    if(slack < 0) return -1; \
+	    size_t room = slack > 0 ? (size_t)slack : 1; \
+	    if(kll_reserve(sk, 0, room) < 0) return -1; \
+	    double *out = sk->items[0] + sk->len[0]; \
+	    size_t m = 0; \
+	    for(; i<n && m<room; i++){ \
+		TYPE x = v[i]; \
+		if(x == b || x != x) continue; \
+		if(x < sk->min) sk->min = x; \
+		if(x > sk->max) sk->max = x; \
+		out[m++] = x; \
+	    } \
+	    sk->len[0] += m; \
+	    sk->n += m; \
+	    slack = kll_compress(sk); \
+	} \
+    }
+
+int kll_add(kll_sketch *sk, const void *in, int dbl, double bad, size_t n)
+{
+    size_t i = 0;
+    if(dbl)
+	KLL_LOOP(double)
+    else
+	KLL_LOOP(float)
+    return 0;
+}
+
+int kll_add_level(kll_sketch *sk, int level, const double *items, size_t n)
+{
+    if(level < 0 || level >= KLL_MXLEV) return -1;
+    if(kll_reserve(sk, level, n) < 0) return -1;
+    memcpy(sk->items[level] + sk->len[level], items, n*sizeof(double));
+    sk->len[level] += n;
+    if(level >= sk->nlev) sk->nlev = level+1;
+    return 0;
+}
+
+int kll_merge(kll_sketch *a, const kll_sketch *b)
+{
+    int h;
+    for(h=0; h<b->nlev; h++)
+	if(kll_add_level(a, h, b->items[h], b->len[h]) < 0) return -1;
+    a->n += b->n;
+    if(b->min < a->min) a->min = b->min;
+    if(b->max > a->max) a->max = b->max;
+    return kll_compress(a) < 0 ? -1 : 0;
+}
+
+typedef struct {
+    double value, weight;
+} kll_item;
+
+static int kll_item_cmp(const void *a, const void *b)
+{
+    double x = ((const kll_item *)a)->value, y = ((const kll_item *)b)->value;
+    return x < y ? -1 : (x > y);
+}
+
+int kll_quantiles(const kll_sketch *sk, const double *q, size_t nq, double *out)
+{
+    size_t i, j, m = 0;
+    int h;
+    for(h=0; h<sk->nlev; h++) m += sk->len[h];
+    kll_item *all = malloc((m ? m : 1)*sizeof(kll_item));
+    if(all == NULL) return -1;
+    for(h=0, m=0; h<sk->nlev; h++)
+	for(i=0; i<sk->len[h]; i++, m++){
+	    all[m].value = sk->items[h][i];
+	    all[m].weight = ldexp(1., h);
+	}
+    qsort(all, m, sizeof(kll_item), kll_item_cmp);
+    // cumulative weights, scaled to the number of values
+    double total = 0.;
+    for(i=0; i<m; i++) total += all[i].weight;
+    for(i=0; i<m; i++)
+	all[i].weight = (i ? all[i-1].weight : 0.) + all[i].weight*sk->n/total;
+
+    for(j=0; j<nq; j++){
+	if(sk->n == 0. || q[j] != q[j]){
+	    out[j] = NAN;
+	}else if(q[j] <= 0.){
+	    out[j] = sk->min;
+	}else if(q[j] >= 1.){
+	    out[j] = sk->max;
+	}else{
+	    // first item whose cumulative weight reaches the rank
+	    double rank = q[j]*sk->n;
+	    size_t lo = 0, hi = m-1;
+	    while(lo < hi){
+		size_t mid = (lo + hi)/2;
+		if(all[mid].weight < rank) lo = mid+1; else hi = mid;
+	    }
+	    out[j] = all[lo].value;
+	}
+    }
+    free(all);
+    return 0;
+}
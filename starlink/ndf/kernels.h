@@ -0,0 +1,123 @@
+//
+// Numerical kernels used by the NDF interface. These work on plain
+// memory and know nothing of Python or the Starlink libraries.
+
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+//
+
+#ifndef STARLINK_NDF_KERNELS_H
+#define STARLINK_NDF_KERNELS_H
+
+#include <stddef.h>
+
+// Copy n elements from in to out replacing the bad value with NaN
+// (bad2nan) or NaN with the bad value (nan2bad). in and out may be the
+// same array but must not otherwise overlap.
+
+void bad2nan_f(const float *in, float *out, size_t n, float bad);
+void bad2nan_d(const double *in, double *out, size_t n, double bad);
+void nan2bad_f(const float *in, float *out, size_t n, float bad);
+void nan2bad_d(const double *in, double *out, size_t n, double bad);
+
+// Block binning. An array of ndim (at most BIN_MXDIM) dimensions is
+// reduced by fac[k] pixels along each axis k into an output array of
+// dimensions odim, all in C order, a chunk at a time. bin_chunk_* adds
+// the chunk in, of dimensions cdim starting at offset coff of the array,
+// to the totals (or maxima) in acc, counting the good pixels of each
+// output pixel in count; both start zeroed. Pixels equal to bad, or NaN,
+// are skipped. bin_finish then turns the totals into the method's result,
+// with NaN for output pixels without any good pixels.
+
+#define BIN_MXDIM 7
+
+enum { BIN_SUM, BIN_MEAN, BIN_MAX };
+
+void bin_chunk_f(const float *in, float bad, int ndim, const size_t *cdim,
+		 const size_t *coff, const size_t *fac, const size_t *odim,
+		 int method, double *acc, size_t *count);
+void bin_chunk_d(const double *in, double bad, int ndim, const size_t *cdim,
+		 const size_t *coff, const size_t *fac, const size_t *odim,
+		 int method, double *acc, size_t *count);
+void bin_finish(int method, double *acc, const size_t *count, size_t n);
+
+// Statistics. A stat_acc holds the number of good values, their mean,
+// sum of squared deviations from the mean, minimum and maximum, and
+// stat_merge combines two of them (Chan et al's pairwise update) so that
+// results for parts of an array can be added together in any order.
+// stat_chunk adds a chunk of an array of dimensions dim, laid out as for
+// bin_chunk_*, into acc: a single accumulator when axis is negative,
+// otherwise one for each element of the array with axis left out, i.e.
+// the product of the other dimensions, in C order. in holds doubles if
+// dbl is set, floats otherwise; values equal to bad, or NaN, are skipped.
+// Runs of good values are accumulated two passes at a time, a block no
+// bigger than the cache at once, and the rows of the chunk are shared
+// out between the threads of pool, created by stat_pool_new for up to
+// nthread threads (the caller's included) and kept for all the chunks
+// of an array. A NULL pool works in the caller's thread alone.
+
+typedef struct {
+    double n, mean, m2, min, max;
+} stat_acc;
+
+typedef struct stat_pool stat_pool;
+
+void stat_merge(stat_acc *a, const stat_acc *b);
+stat_pool *stat_pool_new(int nthread);
+void stat_pool_free(stat_pool *pool);
+int stat_chunk(const void *in, int dbl, double bad, int ndim, const size_t *cdim,
+	       const size_t *coff, const size_t *dim, int axis, stat_pool *pool,
+	       stat_acc *acc);
+
+// Histograms. hist_chunk counts the n values of in (doubles if dbl is
+// set, floats otherwise) into nbin equal bins between lo and hi, the last
+// bin including hi. Values equal to bad, NaN or out of range are skipped.
+
+void hist_chunk(const void *in, int dbl, double bad, size_t n, double lo,
+		double hi, size_t nbin, unsigned long long *counts);
+
+// Quantile sketches, after Karnin, Lang & Liberty (2016). Values are
+// kept in a stack of levels, each holding items which stand for 2^level
+// values. A level which outgrows its capacity is sorted and every other
+// item, starting at random, is promoted to the level above. Capacities
+// shrink by 2/3 per level down from k at the top, so the sketch holds
+// O(k) items whatever the number of values, and quantiles are good to
+// about 1.7/k of the total rank. Sketches of the same k can be merged in
+// any order. kll_init readies an empty sketch, kll_free releases its
+// memory. kll_add adds the good values of in (as for hist_chunk),
+// kll_add_level adds n items to a level directly (used for merging and
+// restoring sketches) and kll_quantiles puts the values at fractional
+// ranks q[0..nq-1] in out. Functions returning int give -1 if memory ran
+// out, 0 otherwise.
+
+#define KLL_MXLEV 60
+
+typedef struct {
+    int k, nlev;
+    double n, min, max;
+    unsigned long long seed;
+    size_t len[KLL_MXLEV], alloc[KLL_MXLEV];
+    double *items[KLL_MXLEV];
+} kll_sketch;
+
+void kll_init(kll_sketch *sk, int k);
+void kll_free(kll_sketch *sk);
+int kll_add(kll_sketch *sk, const void *in, int dbl, double bad, size_t n);
+int kll_add_level(kll_sketch *sk, int level, const double *items, size_t n);
+int kll_merge(kll_sketch *a, const kll_sketch *b);
+int kll_quantiles(const kll_sketch *sk, const double *q, size_t nq, double *out);
+
+#endif
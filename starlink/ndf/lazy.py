@@ -0,0 +1,17 @@
+class lazy(object):
+    """
+    Decorator turning a method into an attribute which is computed on first
+    access and then cached in the instance's dictionary, so later accesses
+    cost nothing. Assigning to the attribute replaces the cached value.
+    """
+
+    def __init__(self, func):
+        self.func = func
+        self.__name__ = func.__name__
+        self.__doc__ = func.__doc__
+
+    def __get__(self, obj, cls):
+        if obj is None:
+            return self
+        value = obj.__dict__[self.__name__] = self.func(obj)
+        return value
@@ -34,8 +34,14 @@
 // this to build with python2.
 #include "npy_3kcompat.h"
 
+// Serialise calls into Starlink with the GIL released
+#include "star_lock.h"
+
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <unistd.h>
 
 // NDF includes
 #include "ndf.h"
@@ -44,24 +50,120 @@
 #include "sae_par.h"
 #include "prm_par.h"
 
+#include "kernels.h"
+
 static PyObject * StarlinkNDFError = NULL;
 
 #if PY_VERSION_HEX >= 0x03000000
 # define USE_PY3K
 #endif
 
-// Define a NDF object
+// Define a NDF object. It counts the live arrays returned by map for
+// each of DATA, QUALITY and VARIANCE (which ERROR maps too), so that
+// unmap and annul can refuse to pull the memory from under them. It
+// also records the depth of the NDF context it was created in.
+
+#define NDF__NVIEW 3
 
 typedef struct {
     PyObject_HEAD
     int _ndfid;
     int _place;
+    int _depth;
+    int _nviews[NDF__NVIEW];
 } NDF;
 
+// The depth of NDF context reached by ndf.begin and the number of live
+// mapped arrays (whether returned by map or by read with copy=False)
+// whose identifiers belong to each context, so that ndf.end can refuse
+// to annul them. Contexts deeper than NDF__MXVCTX share the last count.
+// Only touched with the GIL held.
+
+#define NDF__MXVCTX 64
+
+static int ndf_depth = 0;
+static int ndf_ctxviews[NDF__MXVCTX];
+
+// Define an object to own a mapped array component. It either holds a
+// clone of the NDF identifier through which the component was mapped so
+// that annulling it when the last view of the data disappears unmaps it,
+// or, for components mapped by indf.map, a reference to the NDF object so
+// that its identifier outlives the views.
+
+typedef struct {
+    PyObject_HEAD
+    int _ndfid;
+    PyObject *_owner;
+    int _iview;
+    int _depth;
+    npy_intp _nbytes;
+} NDFMapping;
+
+// Define an iterator over the chunks of an array component.
+
+typedef struct {
+    PyObject_HEAD
+    int _ndfid;
+    int _mxpix;
+    int _nchunk;
+    int _ichunk;
+    int _copy;
+    int _nan;
+    const char *_type;
+    int _ndim;
+    int _lbnd[NDF__MXDIM];
+    char _comp[DAT__SZNAM+1];
+} NDFChunkIter;
+
+static PyTypeObject NDFChunkIterType;
+
+// Define a quantile sketch, which can be added to from several NDFs and
+// merged with others. It is marked busy while data are streamed into it
+// with the GIL released.
+
+typedef struct {
+    PyObject_HEAD
+    kll_sketch _sk;
+    int _busy;
+} NDFSketch;
+
+static PyTypeObject NDFSketchType;
+
+// Define the result of ndf.info, which holds the metadata of an NDF.
+
+static PyStructSequence_Field NDFInfo_fields[] = {
+    {"shape", "dimensions of the NDF, C order"},
+    {"bound", "(lower, upper) pixel bounds, C order"},
+    {"type", "numeric type of the data array"},
+    {"title", "title, None if not defined"},
+    {"label", "label, None if not defined"},
+    {"units", "data units, None if not defined"},
+    {"extensions", "names of the extensions"},
+    {"bad", "bad pixel flag of the data array"},
+    {NULL}
+};
+
+static PyStructSequence_Desc NDFInfo_desc = {
+    "starlink.ndf.api.info",
+    "Metadata of an NDF as returned by ndf.info",
+    NDFInfo_fields,
+    8
+};
+
+static PyTypeObject NDFInfoType;
+
 // Prototypes
 
 static PyObject *
 NDF_create_object( int ndfid, int place );
+static PyObject *
+NDF_wrap_mapped( int *indf, PyObject *owner, int iview, int ndim, npy_intp *rdim,
+                 int typenum, void *ptr, int writeable );
+static PyObject *
+NDF_read_component( int *indf, const char *comp, const char *mtype,
+                    int copy, int nan, int *status );
+static int
+raiseNDFException( int *status );
 
 // Deallocator of this object
 // - we do annul the NDF identifier
@@ -71,12 +173,87 @@ NDF_dealloc(NDF* self)
 {
     int status = SAI__OK;
     errBegin(&status);
+    STAR_BEGIN
+    if (self->_ndfid != NDF__NOID) ndfAnnul( &self->_ndfid, &status);
+    STAR_END
+    if (status != SAI__OK) errAnnul(&status);
+    errEnd(&status);
+    PyObject_Del( self );
+}
+
+// Deallocator of a mapping object - annulling the cloned identifier
+// also unmaps the data
+
+static void
+NDFMapping_dealloc(NDFMapping* self)
+{
+    int status = SAI__OK;
+    errBegin(&status);
+    STAR_BEGIN
+    if (self->_ndfid != NDF__NOID) ndfAnnul( &self->_ndfid, &status);
+    STAR_END
+    STAR_UNMAPPED(self->_nbytes)
+    if (status != SAI__OK) errAnnul(&status);
+    errEnd(&status);
+    if (self->_owner) ((NDF*)self->_owner)->_nviews[self->_iview]--;
+    ndf_ctxviews[self->_depth]--;
+    Py_XDECREF(self->_owner);
+    PyObject_Del( self );
+}
+
+// Deallocator of a chunk iterator
+
+static void
+NDFChunkIter_dealloc(NDFChunkIter* self)
+{
+    int status = SAI__OK;
+    errBegin(&status);
+    STAR_BEGIN
     if (self->_ndfid != NDF__NOID) ndfAnnul( &self->_ndfid, &status);
+    STAR_END
     if (status != SAI__OK) errAnnul(&status);
     errEnd(&status);
     PyObject_Del( self );
 }
 
+// Returns the next chunk as a tuple of its offset from the start of
+// the parent array (C order) and the chunk's data.
+
+static PyObject *
+NDFChunkIter_iternext(NDFChunkIter* self)
+{
+    STAR_ENTRY
+    if (self->_ichunk > self->_nchunk) return NULL;
+
+    int i, ndim, ichk = NDF__NOID, status = SAI__OK;
+    int lbnd[NDF__MXDIM], ubnd[NDF__MXDIM];
+    PyObject *arr = NULL, *offset = NULL;
+
+    errBegin(&status);
+    STAR_BEGIN
+    ndfChunk(self->_ndfid, self->_mxpix, self->_ichunk, &ichk, &status);
+    ndfBound(ichk, NDF__MXDIM, lbnd, ubnd, &ndim, &status);
+    STAR_END
+    if (status == SAI__OK)
+	arr = NDF_read_component(&ichk, self->_comp, self->_type, self->_copy,
+                                 self->_nan, &status);
+    STAR_BEGIN
+    if (ichk != NDF__NOID) ndfAnnul(&ichk, &status);
+    STAR_END
+    if (raiseNDFException(&status) || arr == NULL) goto fail;
+    self->_ichunk++;
+
+    offset = PyTuple_New(ndim);
+    if (offset == NULL) goto fail;
+    for (i=0; i<ndim; i++)
+	PyTuple_SET_ITEM(offset, i, Py_BuildValue("i", lbnd[ndim-i-1] - self->_lbnd[ndim-i-1]));
+    return Py_BuildValue("NN", offset, arr);
+
+fail:
+    Py_XDECREF(arr);
+    return NULL;
+}
+
 // Allocator of an NDF object
 
 static PyObject *
@@ -88,6 +265,8 @@ NDF_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     if (self != NULL) {
         self->_ndfid = NDF__NOID;
         self->_place = NDF__NOPL;
+        self->_depth = ndf_depth < NDF__MXVCTX ? ndf_depth : NDF__MXVCTX-1;
+        memset(self->_nviews, 0, sizeof(self->_nviews));
     }
 
     return (PyObject *)self;
@@ -113,8 +292,9 @@ static void PyDelLoc_ptr(void *ptr)
 {
     HDSLoc* loc = (HDSLoc*)ptr;
     int status = SAI__OK;
+    STAR_BEGIN
     datAnnul(&loc, &status);
-    printf("Inside PyDelLoc\n");
+    STAR_END
     return;
 }
 
@@ -143,7 +323,9 @@ static int tr_iaxis(int indf, int iaxis, int *status)
     // Get dimensions
     const int NDIMX = 10;
     int ndim, idim[NDIMX];
+    STAR_BEGIN
     ndfDim(indf, NDIMX, idim, &ndim, status);
+    STAR_END
     if(*status != SAI__OK) return -1;
     if(iaxis < -1 || iaxis > ndim-1){
 	PyErr_SetString(PyExc_IOError, "tr_axis: axis number too out of range");
@@ -153,6 +335,73 @@ static int tr_iaxis(int indf, int iaxis, int *status)
     return ndim-iaxis;
 }
 
+// Numpy equivalents of the NDF numeric types
+
+static const struct {
+    const char *type;
+    int typenum;
+    size_t nbyte;
+} NDF_TYPES[] = {
+    {"_BYTE",    NPY_BYTE,   sizeof(signed char)},
+    {"_UBYTE",   NPY_UBYTE,  sizeof(unsigned char)},
+    {"_WORD",    NPY_SHORT,  sizeof(short)},
+    {"_UWORD",   NPY_USHORT, sizeof(unsigned short)},
+    {"_INTEGER", NPY_INT,    sizeof(int)},
+    {"_INT64",   NPY_INT64,  sizeof(npy_int64)},
+    {"_REAL",    NPY_FLOAT,  sizeof(float)},
+    {"_DOUBLE",  NPY_DOUBLE, sizeof(double)},
+};
+
+// Translates an NDF numeric type into a numpy type number and the number
+// of bytes per element. Returns -1 if the type is not recognised.
+
+static int ndftype2npy(const char *type, size_t *nbyte)
+{
+    size_t i;
+    for(i=0; i<sizeof(NDF_TYPES)/sizeof(NDF_TYPES[0]); i++){
+	if(strcmp(type, NDF_TYPES[i].type) == 0){
+	    if(nbyte != NULL) *nbyte = NDF_TYPES[i].nbyte;
+	    return NDF_TYPES[i].typenum;
+	}
+    }
+    return -1;
+}
+
+// Translates a Python type specification, either an NDF type name such
+// as "_REAL" or anything numpy accepts as a dtype, into an NDF numeric
+// type. Returns NULL with an exception raised if there is no such type.
+
+static const char *ndf_typearg(PyObject *otype)
+{
+    size_t i, ntype = sizeof(NDF_TYPES)/sizeof(NDF_TYPES[0]);
+
+    // NDF type names first, anything else is left to numpy
+    if(PyUnicode_Check(otype) || PyBytes_Check(otype)){
+	PyObject *bytes = otype;
+	if(PyUnicode_Check(otype)){
+	    bytes = PyUnicode_AsASCIIString(otype);
+	    if(bytes == NULL) return NULL;
+	}else{
+	    Py_INCREF(bytes);
+	}
+	const char *name = PyBytes_AsString(bytes);
+	for(i=0; name != NULL && i<ntype; i++)
+	    if(strcmp(name, NDF_TYPES[i].type) == 0) break;
+	Py_DECREF(bytes);
+	if(i < ntype) return NDF_TYPES[i].type;
+    }
+
+    PyArray_Descr *descr = NULL;
+    if(!PyArray_DescrConverter(otype, &descr)) return NULL;
+    for(i=0; i<ntype; i++)
+	if(PyArray_EquivTypenums(descr->type_num, NDF_TYPES[i].typenum)) break;
+    Py_DECREF(descr);
+    if(i < ntype) return NDF_TYPES[i].type;
+
+    PyErr_SetString(PyExc_ValueError, "no NDF type corresponds to the requested type");
+    return NULL;
+}
+
 // Extracts the contexts of the EMS error stack and raises an
 // exception. Returns true if an exception was raised else
 // false. Can be called as:
@@ -218,11 +467,48 @@ raiseNDFException( int *status )
   return 1;
 }
 
+// Whether comp names component name, ignoring case and allowing it to
+// be abbreviated to no fewer than three characters as NDF does.
+static int
+ndf_compmatch( const char *comp, const char *name )
+{
+    size_t n = strlen(comp);
+    return n >= 3 && n <= strlen(name) && strncasecmp(comp, name, n) == 0;
+}
+
+// Index of the view counter of an NDF object for array component comp,
+// or -1 if it has none. VARIANCE and ERROR share the one array.
+static int
+ndf_viewindex( const char *comp )
+{
+    if (ndf_compmatch(comp, "DATA")) return 0;
+    if (ndf_compmatch(comp, "QUALITY")) return 1;
+    if (ndf_compmatch(comp, "VARIANCE") || ndf_compmatch(comp, "ERROR")) return 2;
+    return -1;
+}
+
+// Raises RuntimeError and returns -1 if arrays returned by map for comp
+// ('*' for any) are still alive, as unmapping now would leave them
+// viewing freed memory.
+static int
+ndf_checkviews( NDF *self, const char *comp, const char *func )
+{
+    int i, iview = ndf_viewindex(comp), n = 0;
+    for (i=0; i<NDF__NVIEW; i++)
+        if (strcmp(comp, "*") == 0 || i == iview) n += self->_nviews[i];
+    if (n > 0) {
+        PyErr_Format( PyExc_RuntimeError, "ndf_%s: %d array(s) returned by map still in use; delete them first", func, n );
+        return -1;
+    }
+    return 0;
+}
+
 // Now onto main routines
 
 static PyObject* 
 pyndf_acget(NDF *self, PyObject *args)
 {
+    STAR_ENTRY
     const char *comp;
     int iaxis;
     if(!PyArg_ParseTuple(args, "si:pyndf_acget", &comp, &iaxis))
@@ -231,16 +517,20 @@ pyndf_acget(NDF *self, PyObject *args)
     // Return None if component does not exist
     int state, status = SAI__OK;
     int naxis = tr_iaxis(self->_ndfid, iaxis, &status);
+    int clen = 0;
     errBegin(&status);
+    STAR_BEGIN
     ndfAstat(self->_ndfid, comp, naxis, &state, &status);
+    if(state) ndfAclen(self->_ndfid, comp, naxis, &clen, &status);
+    STAR_END
     if (raiseNDFException(&status)) return NULL;
     if(!state)
 	Py_RETURN_NONE;
 
-    int clen;
-    ndfAclen(self->_ndfid, comp, naxis, &clen, &status);
     char value[clen+1];
+    STAR_BEGIN
     ndfAcget(self->_ndfid, comp, naxis, value, clen+1, &status);
+    STAR_END
     if (raiseNDFException(&status)) return NULL;
     return Py_BuildValue("s", value);
 };
@@ -248,6 +538,7 @@ pyndf_acget(NDF *self, PyObject *args)
 static PyObject* 
 pyndf_aform(NDF *self, PyObject *args)
 {
+    STAR_ENTRY
     const char *comp;
     int iaxis;
     if(!PyArg_ParseTuple(args, "si:pyndf_aform", &comp, &iaxis))
@@ -256,7 +547,9 @@ pyndf_aform(NDF *self, PyObject *args)
     int naxis = tr_iaxis(self->_ndfid, iaxis, &status);
     char value[30];
     errBegin(&status);
+    STAR_BEGIN
     ndfAform(self->_ndfid, comp, naxis, value, 30, &status);
+    STAR_END
     if (raiseNDFException(&status)) return NULL;
     return Py_BuildValue("s", value);
 };
@@ -265,9 +558,14 @@ pyndf_aform(NDF *self, PyObject *args)
 static PyObject* 
 pyndf_annul(NDF *self)
 {
+    STAR_ENTRY
+    if(ndf_checkviews(self, "*", "annul") < 0)
+	return NULL;
     int status = SAI__OK;
     errBegin(&status);
+    STAR_BEGIN
     ndfAnnul(&self->_ndfid, &status);
+    STAR_END
     if (raiseNDFException(&status)) return NULL;
     Py_RETURN_NONE;
 };
@@ -275,13 +573,16 @@ pyndf_annul(NDF *self)
 static PyObject* 
 pyndf_anorm(NDF *self, PyObject *args)
 {
+    STAR_ENTRY
     int iaxis;
     if(!PyArg_ParseTuple(args, "i:pyndf_anorm", &iaxis))
 	return NULL;
     int state, status = SAI__OK;
     errBegin(&status);
     int naxis = tr_iaxis(self->_ndfid, iaxis, &status);
+    STAR_BEGIN
     ndfAnorm(self->_ndfid, naxis, &state, &status);
+    STAR_END
     if (raiseNDFException(&status)) return NULL;
     return Py_BuildValue("i", state);
 };
@@ -289,6 +590,7 @@ pyndf_anorm(NDF *self, PyObject *args)
 static PyObject* 
 pyndf_aread(NDF *self, PyObject *args)
 {
+    STAR_ENTRY
     int iaxis;
     const char *MMOD = "READ";
     const char *comp;
@@ -299,59 +601,59 @@ pyndf_aread(NDF *self, PyObject *args)
     errBegin(&status);
     int naxis = tr_iaxis(self->_ndfid, iaxis, &status);
 
-    // Return None if component does not exist
+    // Return None if component does not exist, else get the dimensions
+    // and data type
     int state;
-    ndfAstat(self->_ndfid, comp, naxis, &state, &status);
-    if (raiseNDFException(&status)) return NULL;
-    if(!state) Py_RETURN_NONE;
-
-    // Get dimensions
     const int NDIMX = 10;
     int idim[NDIMX], ndim;
-    ndfDim(self->_ndfid, NDIMX, idim, &ndim, &status);
+    const int MXLEN=33;
+    char type[MXLEN];
+    STAR_BEGIN
+    ndfAstat(self->_ndfid, comp, naxis, &state, &status);
+    if(state){
+	ndfDim(self->_ndfid, NDIMX, idim, &ndim, &status);
+	ndfAtype(self->_ndfid, comp, naxis, type, MXLEN, &status);
+    }
+    STAR_END
     if (raiseNDFException(&status)) return NULL;
+    if(!state) Py_RETURN_NONE;
 
     // get number for particular axis in question.
     int nelem = idim[naxis-1];
 
-    // Determine the data type
-    const int MXLEN=33;
-    char type[MXLEN];
-    ndfAtype(self->_ndfid, comp, naxis, type, MXLEN, &status);
-    if (raiseNDFException(&status)) return NULL;
-
     // Create array of correct dimensions and type to save data to
     size_t nbyte;
     ndim = 1;
     npy_intp dim[1] = {nelem};
     PyArrayObject* arr = NULL;
-    if(strcmp(type, "_REAL") == 0){
-	arr = (PyArrayObject*) PyArray_SimpleNew(ndim, dim, PyArray_FLOAT);
-	nbyte = sizeof(float);
-    }else if(strcmp(type, "_DOUBLE") == 0){
-	arr = (PyArrayObject*) PyArray_SimpleNew(ndim, dim, PyArray_DOUBLE);
-	nbyte = sizeof(double);
-    }else if(strcmp(type, "_INTEGER") == 0){
-	arr = (PyArrayObject*) PyArray_SimpleNew(ndim, dim, PyArray_INT);
-	nbyte = sizeof(int);
-    }else{
+    int typenum = ndftype2npy(type, &nbyte);
+    if(typenum < 0){
 	PyErr_SetString(PyExc_IOError, "ndf_aread error: unrecognised data type");
 	goto fail;
     }
+    arr = (PyArrayObject*) PyArray_SimpleNew(ndim, dim, typenum);
     if(arr == NULL) goto fail;
 
     // map, store, unmap
-    int nread;
+    int nread = 0;
     void *pntr[1];
+    STAR_BEGIN
     ndfAmap(self->_ndfid, comp, naxis, type, MMOD, pntr, &nread, &status);
+    STAR_MAPPED(nread*nbyte)
+    if(status == SAI__OK && nelem == nread){
+	STAR_COPY_BEGIN
+	memcpy(arr->data, pntr[0], nelem*nbyte);
+	STAR_COPY_END(nelem*nbyte)
+    }
+    ndfAunmp(self->_ndfid, comp, naxis, &status);
+    STAR_UNMAPPED(nread*nbyte)
+    STAR_END
     if (status != SAI__OK) goto fail;
     if(nelem != nread){
 	printf("nread = %d, nelem = %d, iaxis = %d, %d\n",nread,nelem,iaxis,naxis);
 	PyErr_SetString(PyExc_IOError, "ndf_aread error: number of elements different from number expected");
 	goto fail;
     }
-    memcpy(arr->data, pntr[0], nelem*nbyte);
-    ndfAunmp(self->_ndfid, comp, naxis, &status);
 
     return Py_BuildValue("N", PyArray_Return(arr));
 
@@ -365,6 +667,7 @@ fail:
 static PyObject* 
 pyndf_astat(NDF *self, PyObject *args)
 {
+    STAR_ENTRY
     const char *comp;
     int iaxis;
     if(!PyArg_ParseTuple(args, "si:pyndf_astat", &comp, &iaxis))
@@ -373,7 +676,9 @@ pyndf_astat(NDF *self, PyObject *args)
     errBegin(&status);
     int naxis = tr_iaxis(self->_ndfid, iaxis, &status);
 
+    STAR_BEGIN
     ndfAstat(self->_ndfid, comp, naxis, &state, &status);
+    STAR_END
     if (raiseNDFException(&status)) return NULL;
     return Py_BuildValue("i", state);
 };
@@ -381,10 +686,13 @@ pyndf_astat(NDF *self, PyObject *args)
 static PyObject* 
 pyndf_init(NDF *self, PyObject *args)
 {
+    STAR_ENTRY
     int argc = 0, status = SAI__OK;
     char **argv = NULL;
     errBegin(&status);
+    STAR_BEGIN
     ndfInit(argc, argv, &status);
+    STAR_END
     if (raiseNDFException(&status)) return NULL;
     Py_RETURN_NONE;
 };
@@ -392,13 +700,18 @@ pyndf_init(NDF *self, PyObject *args)
 static PyObject* 
 pyndf_begin(NDF *self)
 {
+    STAR_ENTRY
+    STAR_BEGIN
     ndfBegin();
+    STAR_END
+    ndf_depth++;
     Py_RETURN_NONE;
 };
 
 static PyObject* 
 pyndf_bound(NDF *self)
 {
+    STAR_ENTRY
     int i;
 
     PyArrayObject* bound = NULL;
@@ -411,7 +724,9 @@ pyndf_bound(NDF *self)
 
     int status = SAI__OK;
     errBegin(&status);
+    STAR_BEGIN
     ndfBound(self->_ndfid, NDIMX, lbnd, ubnd, &ndim, &status ); 
+    STAR_END
     if(status != SAI__OK) goto fail;
 
     npy_intp odim[2];
@@ -439,30 +754,50 @@ fail:
 static PyObject* 
 pyndf_cget(NDF *self, PyObject *args)
 {
+    STAR_ENTRY
     const char *comp;
     if(!PyArg_ParseTuple(args, "s:pyndf_cget", &comp))
 	return NULL;
 
     // Return None if component does not exist
-    int state, status = SAI__OK;
+    int state, clen = 0, status = SAI__OK;
     errBegin(&status);
+    STAR_BEGIN
     ndfState(self->_ndfid, comp, &state, &status);
+    if(state) ndfClen(self->_ndfid, comp, &clen, &status);
+    STAR_END
     if (raiseNDFException(&status)) return NULL;
     if(!state)
 	Py_RETURN_NONE;
 
-    int clen;
-    ndfClen(self->_ndfid, comp, &clen, &status);
-    if (raiseNDFException(&status)) return NULL;
     char value[clen+1];
+    STAR_BEGIN
     ndfCget(self->_ndfid, comp, value, clen+1, &status);
+    STAR_END
     if (raiseNDFException(&status)) return NULL;
     return Py_BuildValue("s", value);
 };
 
+// deletes the NDF, annulling the identifier
+static PyObject* 
+pyndf_delet(NDF *self)
+{
+    STAR_ENTRY
+    if(ndf_checkviews(self, "*", "delet") < 0)
+	return NULL;
+    int status = SAI__OK;
+    errBegin(&status);
+    STAR_BEGIN
+    ndfDelet(&self->_ndfid, &status);
+    STAR_END
+    if (raiseNDFException(&status)) return NULL;
+    Py_RETURN_NONE;
+};
+
 static PyObject* 
 pyndf_dim(NDF *self)
 {
+    STAR_ENTRY
     int i;
 
     PyArrayObject* dim = NULL;
@@ -474,7 +809,9 @@ pyndf_dim(NDF *self)
 
     int status = SAI__OK;
     errBegin(&status);
+    STAR_BEGIN
     ndfDim(self->_ndfid, NDIMX, idim, &ndim, &status ); 
+    STAR_END
     if(status != SAI__OK) goto fail;
 
     npy_intp odim[1];
@@ -497,9 +834,21 @@ fail:
 static PyObject* 
 pyndf_end(NDF *self)
 {
+    STAR_ENTRY
+    // ending the context annuls its identifiers, which would unmap the
+    // data from under any arrays still viewing them
+    int ictx = ndf_depth < NDF__MXVCTX ? ndf_depth : NDF__MXVCTX-1;
+    if(ndf_depth > 0 && ndf_ctxviews[ictx] > 0){
+	PyErr_Format(PyExc_RuntimeError, "ndf_end: %d mapped array(s) from this context still in use; delete them first",
+		     ndf_ctxviews[ictx]);
+	return NULL;
+    }
     int status = SAI__OK;
     errBegin(&status);
+    STAR_BEGIN
     ndfEnd(&status);
+    STAR_END
+    if(ndf_depth > 0) ndf_depth--;
     if (raiseNDFException(&status)) return NULL;
     Py_RETURN_NONE;
 };
@@ -508,6 +857,7 @@ pyndf_end(NDF *self)
 static PyObject* 
 pyndf_open(NDF *self, PyObject *args)
 {
+    STAR_ENTRY
     const char *name;
 	const char *mode = "READ";
 	const char *stat = "OLD";
@@ -527,15 +877,116 @@ pyndf_open(NDF *self, PyObject *args)
     errBegin(&status);
     indf = NDF__NOID;
     place = NDF__NOPL;
+    STAR_BEGIN
     ndfOpen( NULL, name, mode, stat, &indf, &place, &status);
+    STAR_END
     if (raiseNDFException(&status)) return NULL;
     return NDF_create_object( indf, place );
 };
 
+// Gathers what is needed to catalogue an NDF without mapping any of its
+// arrays. The NDF is opened read-only and annulled again with a single
+// acquisition of the lock.
+static PyObject*
+pyndf_info(NDF *self, PyObject *args)
+{
+    STAR_ENTRY
+    const char *name;
+    if(!PyArg_ParseTuple(args, "s:pyndf_info", &name))
+	return NULL;
+
+    static const char *CCOMPS[] = {"Title", "Label", "Units"};
+    const int NCCOMP = 3;
+    int i, indf = NDF__NOID, place = NDF__NOPL;
+    int ndim = 0, bad = 0, nextn = 0, nomem = 0;
+    int lbnd[NDF__MXDIM], ubnd[NDF__MXDIM], state[3], clen[3];
+    char type[DAT__SZTYP+1];
+    char *cvalue[3] = {NULL, NULL, NULL};
+    char (*xname)[DAT__SZNAM+1] = NULL;
+    PyObject *info = NULL, *shape = NULL, *lower = NULL, *upper = NULL, *xnames = NULL;
+
+    int status = SAI__OK;
+    errBegin(&status);
+    STAR_BEGIN
+    ndfOpen(NULL, name, "READ", "OLD", &indf, &place, &status);
+    ndfBound(indf, NDF__MXDIM, lbnd, ubnd, &ndim, &status);
+    ndfType(indf, "DATA", type, DAT__SZTYP+1, &status);
+    ndfBad(indf, "DATA", 0, &bad, &status);
+    for(i=0; i<NCCOMP; i++){
+	state[i] = 0;
+	ndfState(indf, CCOMPS[i], &state[i], &status);
+	if(state[i]) ndfClen(indf, CCOMPS[i], &clen[i], &status);
+	if(state[i] && status == SAI__OK){
+	    cvalue[i] = malloc(clen[i]+1);
+	    if(cvalue[i] == NULL)
+		nomem = 1;
+	    else
+		ndfCget(indf, CCOMPS[i], cvalue[i], clen[i]+1, &status);
+	}
+    }
+    ndfXnumb(indf, &nextn, &status);
+    if(status == SAI__OK && nextn > 0){
+	xname = malloc(nextn*sizeof(*xname));
+	if(xname == NULL) nomem = 1;
+	for(i=0; xname && i<nextn; i++)
+	    ndfXname(indf, i+1, xname[i], DAT__SZNAM+1, &status);
+    }
+    if(indf != NDF__NOID) ndfAnnul(&indf, &status);
+    STAR_END
+    if (raiseNDFException(&status)) goto fail;
+    if(nomem){
+	PyErr_NoMemory();
+	goto fail;
+    }
+
+    // Dimensions and bounds are given in C order
+    shape = PyTuple_New(ndim);
+    lower = PyTuple_New(ndim);
+    upper = PyTuple_New(ndim);
+    xnames = PyTuple_New(nextn);
+    info = PyStructSequence_New(&NDFInfoType);
+    if(!shape || !lower || !upper || !xnames || !info) goto fail;
+    for(i=0; i<ndim; i++){
+	PyTuple_SET_ITEM(shape, i, Py_BuildValue("i", ubnd[ndim-i-1]-lbnd[ndim-i-1]+1));
+	PyTuple_SET_ITEM(lower, i, Py_BuildValue("i", lbnd[ndim-i-1]));
+	PyTuple_SET_ITEM(upper, i, Py_BuildValue("i", ubnd[ndim-i-1]));
+    }
+    for(i=0; i<nextn; i++)
+	PyTuple_SET_ITEM(xnames, i, Py_BuildValue("s", xname[i]));
+
+    PyStructSequence_SET_ITEM(info, 0, shape);
+    PyStructSequence_SET_ITEM(info, 1, Py_BuildValue("NN", lower, upper));
+    PyStructSequence_SET_ITEM(info, 2, Py_BuildValue("s", type));
+    for(i=0; i<NCCOMP; i++){
+	if(cvalue[i]){
+	    PyStructSequence_SET_ITEM(info, 3+i, Py_BuildValue("s", cvalue[i]));
+	}else{
+	    Py_INCREF(Py_None);
+	    PyStructSequence_SET_ITEM(info, 3+i, Py_None);
+	}
+    }
+    PyStructSequence_SET_ITEM(info, 6, xnames);
+    PyStructSequence_SET_ITEM(info, 7, PyBool_FromLong(bad));
+    for(i=0; i<NCCOMP; i++) free(cvalue[i]);
+    free(xname);
+    return info;
+
+fail:
+    for(i=0; i<NCCOMP; i++) free(cvalue[i]);
+    free(xname);
+    Py_XDECREF(shape);
+    Py_XDECREF(lower);
+    Py_XDECREF(upper);
+    Py_XDECREF(xnames);
+    Py_XDECREF(info);
+    return NULL;
+};
+
 // create a new NDF (simple) structure
 static PyObject*
 pyndf_new(NDF *self, PyObject *args)
 {
+	STAR_ENTRY
 	// use ultracam defaults
 	const char *ftype = "_REAL";
 	int ndim;
@@ -555,7 +1006,9 @@ pyndf_new(NDF *self, PyObject *args)
 		return NULL;
         errBegin(&status);
         int indf = NDF__NOID;
+	STAR_BEGIN
 	ndfNew(ftype,ndim,(int*)PyArray_DATA(lower),(int*)PyArray_DATA(upper),&self->_place,&indf,&status); // placeholder annulled by this routine
+	STAR_END
 	Py_DECREF(lower);
 	Py_DECREF(upper);
 	if (raiseNDFException(&status))
@@ -563,39 +1016,354 @@ pyndf_new(NDF *self, PyObject *args)
 	return NDF_create_object( indf, NDF__NOPL);
 }
 
-// this copies a block of memory from a numpy array to a memory address
+// Converts pixel bounds given in C order, as returned by bound(), into
+// the Fortran order arrays that NDF wants. Returns the number of
+// dimensions, or -1 with an exception set.
+static int
+ndf_boundsarg(PyObject *lb, PyObject *ub, int *lbnd, int *ubnd)
+{
+	int i, ndim = -1;
+	PyArrayObject* lower = (PyArrayObject*) PyArray_FROM_OTF(lb, NPY_INT, NPY_IN_ARRAY | NPY_FORCECAST);
+	PyArrayObject* upper = (PyArrayObject*) PyArray_FROM_OTF(ub, NPY_INT, NPY_IN_ARRAY | NPY_FORCECAST);
+	if (lower && upper) {
+		ndim = PyArray_SIZE(lower);
+		if(ndim < 1 || ndim > NDF__MXDIM || PyArray_SIZE(upper) != ndim) {
+			PyErr_SetString( PyExc_ValueError, "bounds must be two sequences of 1 to 7 values each" );
+			ndim = -1;
+		} else {
+			int *l = (int*)PyArray_DATA(lower), *u = (int*)PyArray_DATA(upper);
+			for(i=0; i<ndim; i++) {
+				lbnd[i] = l[ndim-i-1];
+				ubnd[i] = u[ndim-i-1];
+			}
+		}
+	}
+	Py_XDECREF(lower);
+	Py_XDECREF(upper);
+	return ndim;
+}
+
+// change the pixel bounds of an NDF, keeping the values of pixels common
+// to the old and new bounds
+static PyObject*
+pyndf_sbnd(NDF *self, PyObject *args)
+{
+	STAR_ENTRY
+	PyObject *lb, *ub;
+	int lbnd[NDF__MXDIM], ubnd[NDF__MXDIM];
+	if(!PyArg_ParseTuple(args, "OO:pyndf_sbnd", &lb, &ub))
+		return NULL;
+	int ndim = ndf_boundsarg(lb, ub, lbnd, ubnd);
+	if(ndim < 0)
+		return NULL;
+	int status = SAI__OK;
+        errBegin(&status);
+	STAR_BEGIN
+	ndfSbnd(ndim, lbnd, ubnd, self->_ndfid, &status);
+	STAR_END
+	if (raiseNDFException(&status))
+		return NULL;
+	Py_RETURN_NONE;
+}
+
+// create a section of an NDF
+static PyObject*
+pyndf_sect(NDF *self, PyObject *args)
+{
+	STAR_ENTRY
+	PyObject *lb, *ub;
+	int lbnd[NDF__MXDIM], ubnd[NDF__MXDIM];
+	if(!PyArg_ParseTuple(args, "OO:pyndf_sect", &lb, &ub))
+		return NULL;
+	int ndim = ndf_boundsarg(lb, ub, lbnd, ubnd);
+	if(ndim < 0)
+		return NULL;
+	int status = SAI__OK;
+        errBegin(&status);
+        int isect = NDF__NOID;
+	STAR_BEGIN
+	ndfSect(self->_ndfid, ndim, lbnd, ubnd, &isect, &status);
+	STAR_END
+	if (raiseNDFException(&status))
+		return NULL;
+	return NDF_create_object( isect, NDF__NOPL);
+}
+
+// Converts a numpy-style key of integers and slices, in C order and
+// counted from the first pixel, into the start, step and length of the
+// selection along each axis (also C order). Integers select a single
+// pixel and are flagged in isint. Missing trailing indices take the whole
+// axis. Returns the number of dimensions, with the Fortran order lower
+// bounds of the NDF in lbnd, or -1 with an exception set.
+static int
+ndf_keyarg(NDF *self, PyObject *key, int *lbnd, Py_ssize_t *start,
+	   Py_ssize_t *step, Py_ssize_t *len, int *isint)
+{
+	int k, ndim = 0, ubnd[NDF__MXDIM];
+	Py_ssize_t dim, stop, nkey;
+	PyObject *item;
+
+	int status = SAI__OK;
+	errBegin(&status);
+	STAR_BEGIN
+	ndfBound(self->_ndfid, NDF__MXDIM, lbnd, ubnd, &ndim, &status);
+	STAR_END
+	if (raiseNDFException(&status))
+		return -1;
+
+	if(PyTuple_Check(key)){
+		Py_INCREF(key);
+	}else{
+		key = Py_BuildValue("(O)", key);
+		if(key == NULL) return -1;
+	}
+	nkey = PyTuple_GET_SIZE(key);
+	if(nkey > ndim){
+		PyErr_SetString(PyExc_IndexError, "ndf_section: too many indices");
+		goto fail;
+	}
+
+	for(k=0; k<ndim; k++){
+		dim = ubnd[ndim-k-1] - lbnd[ndim-k-1] + 1;
+		item = k < nkey ? PyTuple_GET_ITEM(key, k) : NULL;
+		isint[k] = 0;
+		if(item == NULL){
+			start[k] = 0;
+			step[k] = 1;
+			len[k] = dim;
+		}else if(PySlice_Check(item)){
+			if(PySlice_GetIndicesEx((void*)item, dim, &start[k], &stop, &step[k], &len[k]) < 0)
+				goto fail;
+		}else{
+			start[k] = PyNumber_AsSsize_t(item, PyExc_IndexError);
+			if(start[k] == -1 && PyErr_Occurred()) goto fail;
+			if(start[k] < 0) start[k] += dim;
+			if(start[k] < 0 || start[k] >= dim){
+				PyErr_SetString(PyExc_IndexError, "ndf_section: index out of range");
+				goto fail;
+			}
+			step[k] = len[k] = isint[k] = 1;
+		}
+	}
+	Py_DECREF(key);
+	return ndim;
+
+fail:
+	Py_DECREF(key);
+	return -1;
+}
+
+// create a section of an NDF from a numpy-style key
 static PyObject*
-pyndf_numpytoptr(NDF *self, PyObject *args)
+pyndf_section(NDF *self, PyObject *args)
 {
+	STAR_ENTRY
+	PyObject *key;
+	int k, f, lbnd[NDF__MXDIM], ubnd[NDF__MXDIM], isint[NDF__MXDIM];
+	Py_ssize_t start[NDF__MXDIM], step[NDF__MXDIM], len[NDF__MXDIM];
+	if(!PyArg_ParseTuple(args, "O:pyndf_section", &key))
+		return NULL;
+	int ndim = ndf_keyarg(self, key, lbnd, start, step, len, isint);
+	if(ndim < 0)
+		return NULL;
+	for(k=0; k<ndim; k++){
+		if(len[k] == 0){
+			PyErr_SetString(PyExc_IndexError, "ndf_section: section would be empty");
+			return NULL;
+		}
+		if(step[k] != 1 && len[k] > 1){
+			PyErr_SetString(PyExc_ValueError, "ndf_section: sections cannot have steps; index the NDF instead");
+			return NULL;
+		}
+		f = ndim-k-1;
+		ubnd[f] = lbnd[f] + start[k] + len[k] - 1;
+		lbnd[f] += start[k];
+	}
+	int status = SAI__OK;
+	errBegin(&status);
+	int isect = NDF__NOID;
+	STAR_BEGIN
+	ndfSect(self->_ndfid, ndim, lbnd, ubnd, &isect, &status);
+	STAR_END
+	if (raiseNDFException(&status))
+		return NULL;
+	return NDF_create_object( isect, NDF__NOPL);
+}
+
+// indf[key] -- reads the selected pixels of the data component. Only the
+// bounding box of the selection is mapped, through a section of this
+// NDF, and steps are gathered from it into the result. When the first
+// (slowest) axis is stepped, the box is taken one plane at a time so that
+// the planes skipped over are never read.
+static PyObject*
+NDF_subscript(NDF *self, PyObject *key)
+{
+	STAR_ENTRY
+	int i, k, f, nout = 0, nplane = 1, post = 0;
+	int lbnd[NDF__MXDIM], slbnd[NDF__MXDIM], subnd[NDF__MXDIM], isint[NDF__MXDIM];
+	Py_ssize_t start[NDF__MXDIM], step[NDF__MXDIM], len[NDF__MXDIM];
+	npy_intp odim[NDF__MXDIM];
+	size_t nbyte;
+	const int MXLEN=32;
+	char type[MXLEN+1];
+	PyObject *index = NULL, *sub, *view, *src, *dst, *out = NULL;
+
+	int ndim = ndf_keyarg(self, key, lbnd, start, step, len, isint);
+	if(ndim < 0)
+		return NULL;
+	for(k=0; k<ndim; k++){
+		if(!isint[k]) odim[nout++] = len[k];
+		if(step[k] != 1 || isint[k]) post = 1;
+	}
+	if(step[0] != 1 && step[0] != -1) nplane = len[0];
+
+	int status = SAI__OK;
+	errBegin(&status);
+	STAR_BEGIN
+	ndfType(self->_ndfid, "DATA", type, MXLEN+1, &status);
+	STAR_END
+	if (raiseNDFException(&status))
+		return NULL;
+	int typenum = ndftype2npy(type, &nbyte);
+	if(typenum < 0){
+		PyErr_SetString(PyExc_IOError, "ndf_section error: unrecognised data type");
+		return NULL;
+	}
+
+	out = PyArray_SimpleNew(nout, odim, typenum);
+	if(out == NULL) return NULL;
+	for(k=0; k<ndim; k++)
+		if(len[k] == 0) return PyArray_Return((PyArrayObject*)out);
+
+	// what to take from each box, which is a single plane of out when
+	// they are read one by one
+	index = PyTuple_New(ndim);
+	if(index == NULL) goto fail;
+	for(k=0; k<ndim; k++){
+		if(isint[k]){
+			sub = PyInt_FromLong(0);
+		}else{
+			PyObject *ostep = PyInt_FromLong(k == 0 && nplane > 1 ? 1 : step[k]);
+			sub = ostep ? PySlice_New(NULL, NULL, ostep) : NULL;
+			Py_XDECREF(ostep);
+		}
+		if(sub == NULL) goto fail;
+		PyTuple_SET_ITEM(index, k, sub);
+	}
+
+	for(k=0; k<ndim; k++){
+		f = ndim-k-1;
+		slbnd[f] = lbnd[f] + (step[k] > 0 ? start[k] : start[k] + (len[k]-1)*step[k]);
+		subnd[f] = lbnd[f] + (step[k] > 0 ? start[k] + (len[k]-1)*step[k] : start[k]);
+	}
+
+	for(i=0; i<nplane; i++){
+		if(nplane > 1)
+			slbnd[ndim-1] = subnd[ndim-1] = lbnd[ndim-1] + start[0] + i*step[0];
+
+		int isect = NDF__NOID;
+		STAR_BEGIN
+		ndfSect(self->_ndfid, ndim, slbnd, subnd, &isect, &status);
+		STAR_END
+		if(status != SAI__OK) goto fail;
+
+		// a plain box is copied straight out; anything else views the
+		// mapped section and gathers from it
+		view = NDF_read_component(&isect, "DATA", type, !post, 0, &status);
+		if(isect != NDF__NOID){
+			STAR_BEGIN
+			ndfAnnul(&isect, &status);
+			STAR_END
+		}
+		if(view == NULL) goto fail;
+		if(!post){
+			Py_DECREF(out);
+			out = view;
+			break;
+		}
+		src = PyObject_GetItem(view, index);
+		dst = nplane > 1 ? PySequence_GetSlice(out, i, i+1) : out;
+		if(src != NULL && dst != NULL){
+			STAR_COPY_BEGIN
+			if(PyArray_CopyObject((PyArrayObject*)dst, src) < 0)
+				Py_CLEAR(src);
+			STAR_COPY_END(PyArray_NBYTES((PyArrayObject*)dst))
+		}
+		if(nplane > 1) Py_XDECREF(dst);
+		Py_DECREF(view);
+		if(src == NULL || dst == NULL){
+			Py_XDECREF(src);
+			goto fail;
+		}
+		Py_DECREF(src);
+	}
+	Py_DECREF(index);
+	if (raiseNDFException(&status)){
+		Py_DECREF(out);
+		return NULL;
+	}
+	return PyArray_Return((PyArrayObject*)out);
+
+fail:
+	Py_XDECREF(index);
+	Py_XDECREF(out);
+	raiseNDFException(&status);
+	return NULL;
+}
+
+// this copies a block of memory from a numpy array to a memory address,
+// optionally replacing NaNs with the bad value on the way
+static PyObject*
+pyndf_numpytoptr(NDF *self, PyObject *args, PyObject *kwds)
+{
+	STAR_ENTRY
 	PyObject *npy, *ptrobj;
 	PyArrayObject *npyarray;
-	int el;
+	int el, nan = 0;
 	size_t bytes;
 	const char *ftype;
-	if(!PyArg_ParseTuple(args, "OOis:pyndf_numpytoptr",&npy,&ptrobj,&el,&ftype))
+	static char *kwlist[] = {"array", "pointer", "elements", "type", "nan", NULL};
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "OOis|i:pyndf_numpytoptr", kwlist,
+					&npy,&ptrobj,&el,&ftype,&nan))
 		return NULL;
-	void *ptr = NpyCapsule_AsVoidPtr(ptrobj);
-	if (el <= 0 || ptr == NULL)
+	int typenum = ndftype2npy(ftype, &bytes);
+	if(typenum < 0) {
+		PyErr_SetString( PyExc_ValueError, "Unsupported NDF data type" );
 		return NULL;
-	if(strcmp(ftype,"_INTEGER") == 0) {
-		npyarray = (PyArrayObject*) PyArray_FROM_OTF(npy, NPY_INT, NPY_IN_ARRAY | NPY_FORCECAST);
-		bytes = sizeof(int);
-	} else if(strcmp(ftype,"_REAL") == 0) {
-		npyarray = (PyArrayObject*) PyArray_FROM_OTF(npy, NPY_FLOAT, NPY_IN_ARRAY | NPY_FORCECAST);
-		bytes = sizeof(float);
-	} else if(strcmp(ftype,"_DOUBLE") == 0) {
-		npyarray = (PyArrayObject*) PyArray_FROM_OTF(npy, NPY_DOUBLE, NPY_IN_ARRAY | NPY_FORCECAST);
-		bytes = sizeof(double);
-	} else if(strcmp(ftype,"_BYTE") == 0) {
-		npyarray = (PyArrayObject*) PyArray_FROM_OTF(npy, NPY_BYTE, NPY_IN_ARRAY | NPY_FORCECAST);
-		bytes = sizeof(char);
-	} else if(strcmp(ftype,"_UBYTE") == 0) {
-		npyarray = (PyArrayObject*) PyArray_FROM_OTF(npy, NPY_UBYTE, NPY_IN_ARRAY | NPY_FORCECAST);
-		bytes = sizeof(char);
+	}
+	// the pointer may be an array returned by map, or a bare capsule
+	void *ptr;
+	if (PyArray_Check(ptrobj)) {
+		if (!PyArray_ISCARRAY((PyArrayObject*)ptrobj) ||
+		    PyArray_NBYTES((PyArrayObject*)ptrobj) < el*bytes) {
+			PyErr_SetString( PyExc_ValueError, "ndf_numpytoptr: pointer array too small or not writeable" );
+			return NULL;
+		}
+		ptr = PyArray_DATA((PyArrayObject*)ptrobj);
 	} else {
+		ptr = NpyCapsule_AsVoidPtr(ptrobj);
+	}
+	if (el <= 0 || ptr == NULL)
+		return NULL;
+	npyarray = (PyArrayObject*) PyArray_FROM_OTF(npy, typenum, NPY_IN_ARRAY | NPY_FORCECAST);
+	if (npyarray == NULL)
+		return NULL;
+	if (PyArray_SIZE(npyarray) < el) {
+		PyErr_SetString( PyExc_ValueError, "ndf_numpytoptr: array has too few elements" );
+		Py_DECREF(npyarray);
 		return NULL;
 	}
-	memcpy(ptr,PyArray_DATA(npyarray),el*bytes);
+	// no Starlink calls here so no need for the lock
+	STAR_COPY_BEGIN
+	Py_BEGIN_ALLOW_THREADS
+	if(nan && typenum == NPY_FLOAT)
+		nan2bad_f((float *)PyArray_DATA(npyarray), (float *)ptr, el, VAL__BADR);
+	else if(nan && typenum == NPY_DOUBLE)
+		nan2bad_d((double *)PyArray_DATA(npyarray), (double *)ptr, el, VAL__BADD);
+	else
+		memcpy(ptr,PyArray_DATA(npyarray),el*bytes);
+	Py_END_ALLOW_THREADS
+	STAR_COPY_END(el*bytes)
 	Py_DECREF(npyarray);
 	Py_RETURN_NONE;
 }
@@ -604,8 +1372,9 @@ pyndf_numpytoptr(NDF *self, PyObject *args)
 inline int checkHDStype(const char *type)
 {
 	if(strcmp(type,"_INTEGER") != 0 && strcmp(type,"_REAL") != 0 && strcmp(type,"_DOUBLE") != 0 &&
-			strcmp(type,"_LOGICAL") != 0 && strcmp(type,"_WORD") != 0 && strcmp(type,"UWORD") != 0 &&
-			strcmp(type,"_BYTE") != 0 && strcmp(type,"_UBYTE") != 0 && strcmp(type,"_CHAR") != 0 &&
+			strcmp(type,"_LOGICAL") != 0 && strcmp(type,"_WORD") != 0 && strcmp(type,"_UWORD") != 0 &&
+			strcmp(type,"_BYTE") != 0 && strcmp(type,"_UBYTE") != 0 && strcmp(type,"_INT64") != 0 &&
+			strcmp(type,"_CHAR") != 0 &&
 			strncmp(type,"_CHAR*",6) != 0)
 		return 0;
 	else
@@ -616,6 +1385,7 @@ inline int checkHDStype(const char *type)
 static PyObject*
 pyndf_xnew(NDF *self, PyObject *args)
 {
+	STAR_ENTRY
 	int ndim = 0;
 	const char *xname, *type;
 	PyObject *dim;
@@ -635,21 +1405,25 @@ pyndf_xnew(NDF *self, PyObject *args)
 		if (PyArray_SIZE(npydim) != ndim)
 			return NULL;
                 errBegin(&status);
+		STAR_BEGIN
 		ndfXnew(self->_ndfid,xname,type,ndim,(int*)PyArray_DATA(npydim),&loc,&status);
+		STAR_END
 		Py_DECREF(npydim);
 	} else {
 		// making an ext/struct
                 errBegin(&status);
+		STAR_BEGIN
 		ndfXnew(self->_ndfid,xname,type,0,0,&loc,&status);
+		STAR_END
 	}
         if (raiseNDFException(&status)) return NULL;
-	PyObject* pobj = NpyCapsule_FromVoidPtr(loc, PyDelLoc);
-	return Py_BuildValue("O",pobj);
+	return NpyCapsule_FromVoidPtr(loc, PyDelLoc);
 }
 
 static PyObject*
 pyndf_getbadpixval(NDF *self, PyObject *args)
 {
+	STAR_ENTRY
 	const char *type;
 	if(!PyArg_ParseTuple(args, "s:pyndf_getpadpixval", &type))
 		return NULL;
@@ -659,15 +1433,31 @@ pyndf_getbadpixval(NDF *self, PyObject *args)
 		return Py_BuildValue("f",VAL__BADR);
 	else if (strcmp(type,"_INTEGER") == 0)
 		return Py_BuildValue("i",VAL__BADI);
-	else
+	else if (strcmp(type,"_INT64") == 0)
+		return Py_BuildValue("L",(PY_LONG_LONG)VAL__BADK);
+	else if (strcmp(type,"_WORD") == 0)
+		return Py_BuildValue("i",(int)VAL__BADW);
+	else if (strcmp(type,"_UWORD") == 0)
+		return Py_BuildValue("i",(int)VAL__BADUW);
+	else if (strcmp(type,"_BYTE") == 0)
+		return Py_BuildValue("i",(int)VAL__BADB);
+	else if (strcmp(type,"_UBYTE") == 0)
+		return Py_BuildValue("i",(int)VAL__BADUB);
+	else {
+		PyErr_SetString( PyExc_ValueError, "Unsupported NDF data type" );
 		return NULL;
+	}
 }
 
 // map access to array component
 static PyObject*
 pyndf_map(NDF *self, PyObject* args)
 {
-	int el;
+	STAR_ENTRY
+	int i, el, ndim;
+	int idim[NDF__MXDIM];
+	npy_intp rdim[NDF__MXDIM];
+	size_t nbyte;
 	void* ptr;
 	const char* comp;
 	const char* type;
@@ -694,18 +1484,31 @@ pyndf_map(NDF *self, PyObject* args)
                 PyErr_SetString( PyExc_ValueError, "QUALITY requires type _UBYTE" );
 		return NULL;
         }
+	int typenum = ndftype2npy(type, &nbyte);
+	if(typenum < 0) {
+                PyErr_SetString( PyExc_ValueError, "Unsupported NDF data type" );
+		return NULL;
+        }
         errBegin(&status);
+	STAR_BEGIN
+	ndfDim(self->_ndfid,NDF__MXDIM,idim,&ndim,&status);
 	ndfMap(self->_ndfid,comp,type,mmod,&ptr,&el,&status);
+	STAR_END
 	if (raiseNDFException(&status))
 		return NULL;
-	PyObject* ptrobj = NpyCapsule_FromVoidPtr(ptr,NULL);
-	return Py_BuildValue("Oi",ptrobj,el);
+
+	// the array views the mapped memory and keeps this object alive
+	int indf = NDF__NOID;
+	for(i=0; i<ndim; i++) rdim[i] = idim[ndim-i-1];
+	return NDF_wrap_mapped(&indf, (PyObject*)self, ndf_viewindex(comp), ndim, rdim,
+			       typenum, ptr, strcmp(mmod,"READ") != 0);
 }
 
 // unmap an NDF or mapped array
 static PyObject*
 pyndf_unmap(NDF* self, PyObject* args)
 {
+	STAR_ENTRY
 	const char* comp;
 	if(!PyArg_ParseTuple(args,"s:pyndf_unmap",&comp))
 		return NULL;
@@ -716,104 +1519,1015 @@ pyndf_unmap(NDF* self, PyObject* args)
                 PyErr_SetString( PyExc_ValueError, "Unsupported NDF data component to unmap" );
 		return NULL;
         }
+	if(ndf_checkviews(self, comp, "unmap") < 0)
+		return NULL;
         errBegin(&status);
+	STAR_BEGIN
 	ndfUnmap(self->_ndfid,comp,&status);
+	STAR_END
 	if (raiseNDFException(&status))
 		return NULL;
 	Py_RETURN_NONE;
 }
 
-// Reads an NDF into a numpy array
-static PyObject* 
-pyndf_read(NDF *self, PyObject *args)
+// write a numpy array to an array component. The mapped component is
+// wrapped in an array of its own type so that numpy converts and copies
+// straight into it, whatever the type and strides of the input. With
+// nan set, floating point input that already matches the mapped data is
+// instead translated as it is copied; anything else is translated in
+// place once numpy has copied it.
+static PyObject*
+pyndf_write(NDF *self, PyObject *args, PyObject *kwds)
 {
-    int i;
-    const char *comp;
-    if(!PyArg_ParseTuple(args, "s:pyndf_read", &comp))
-	return NULL;
+	STAR_ENTRY
+	const char *comp;
+	PyObject *obj;
+	int nan = 0;
+	static char *kwlist[] = {"comp", "array", "nan", NULL};
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "sO|i:pyndf_write", kwlist,
+					&comp, &obj, &nan))
+		return NULL;
 
-    // series of declarations in an attempt to avoid problem with
-    // goto fail
-    const int MXLEN=32;
-    char type[MXLEN+1];
-    size_t nbyte;
-    int npix, nelem;
+	// series of declarations in an attempt to avoid problem with
+	// goto fail
+	const int MXLEN=32;
+	char type[MXLEN+1];
+	int i, ndim, npix, nelem = 0, typenum, copied = 0;
+	int idim[NDF__MXDIM];
+	npy_intp rdim[NDF__MXDIM];
+	size_t nbyte;
+	void *pntr[1];
+	PyArrayObject *src = NULL, *dst = NULL;
+	int status = SAI__OK;
 
-    // Return None if component does not exist
-    int state, status = SAI__OK;
-    errBegin(&status);
+	src = (PyArrayObject*) PyArray_FROM_O(obj);
+	if(src == NULL) return NULL;
+
+	errBegin(&status);
+	STAR_BEGIN
+	ndfDim(self->_ndfid, NDF__MXDIM, idim, &ndim, &status);
+	ndfSize(self->_ndfid, &npix, &status);
+	ndfType(self->_ndfid, comp, type, MXLEN+1, &status);
+	STAR_END
+	if (raiseNDFException(&status)) goto fail;
+
+	// Reverse order to account for C vs Fortran
+	for(i=0; i<ndim; i++) rdim[i] = idim[ndim-i-1];
+	if(PyArray_NDIM(src) != ndim || !PyArray_CompareLists(PyArray_DIMS(src), rdim, ndim)) {
+		PyErr_SetString( PyExc_ValueError, "ndf_write: array shape does not match the NDF" );
+		goto fail;
+	}
+	typenum = ndftype2npy(type, &nbyte);
+	if(typenum < 0) {
+		PyErr_SetString( PyExc_ValueError, "Unsupported NDF data type" );
+		goto fail;
+	}
+
+	STAR_BEGIN
+	ndfMap(self->_ndfid, comp, type, "WRITE", pntr, &nelem, &status);
+	STAR_END
+	if (raiseNDFException(&status)) goto fail;
+	STAR_MAPPED(nelem*nbyte)
+
+	// no Starlink calls while copying so no need for the lock
+	nan = nan && (typenum == NPY_FLOAT || typenum == NPY_DOUBLE);
+	if(nelem != npix) {
+		PyErr_SetString( PyExc_IOError, "ndf_write error: number of elements different from number expected" );
+	} else if(nan && PyArray_TYPE(src) == typenum && PyArray_ISCARRAY_RO(src) &&
+		  PyArray_ISNOTSWAPPED(src)) {
+		STAR_COPY_BEGIN
+		Py_BEGIN_ALLOW_THREADS
+		if(typenum == NPY_FLOAT)
+			nan2bad_f((float *)PyArray_DATA(src), (float *)pntr[0], npix, VAL__BADR);
+		else
+			nan2bad_d((double *)PyArray_DATA(src), (double *)pntr[0], npix, VAL__BADD);
+		Py_END_ALLOW_THREADS
+		STAR_COPY_END(nelem*nbyte)
+		copied = 1;
+	} else {
+		dst = (PyArrayObject*) PyArray_New(&PyArray_Type, ndim, rdim, typenum,
+						   NULL, pntr[0], 0, NPY_CARRAY, NULL);
+		STAR_COPY_BEGIN
+		copied = dst != NULL && PyArray_CopyInto(dst, src) == 0;
+		if(copied && nan) {
+			Py_BEGIN_ALLOW_THREADS
+			if(typenum == NPY_FLOAT)
+				nan2bad_f((float *)pntr[0], (float *)pntr[0], npix, VAL__BADR);
+			else
+				nan2bad_d((double *)pntr[0], (double *)pntr[0], npix, VAL__BADD);
+			Py_END_ALLOW_THREADS
+		}
+		STAR_COPY_END(nelem*nbyte)
+		Py_XDECREF(dst);
+	}
+
+	// A component left half written is reset to undefined
+	STAR_BEGIN
+	ndfUnmap(self->_ndfid, comp, &status);
+	if(!copied) ndfReset(self->_ndfid, comp, &status);
+	STAR_END
+	STAR_UNMAPPED(nelem*nbyte)
+	if (raiseNDFException(&status) || !copied) goto fail;
+	Py_DECREF(src);
+	Py_RETURN_NONE;
+
+fail:
+	Py_XDECREF(src);
+	return NULL;
+}
+
+// Reads array component comp of the NDF identified by *indf into a
+// numpy array of NDF type mtype, or of the component's own type if mtype
+// is NULL. Any conversion is done by NDF as the data are mapped. If nan
+// is set, bad values in floating point data are replaced by NaN as they
+// are copied (other types are left alone). With copy set the data are
+// copied and the component is unmapped again. Otherwise the array views
+// the mapped data and *indf is handed over to it (see NDF_wrap_mapped),
+// so the caller must pass an identifier of its own. Returns NULL on
+// error, which may be reported either through status or as a Python
+// exception.
+
+static PyObject *
+NDF_read_component( int *indf, const char *comp, const char *mtype,
+                    int copy, int nan, int *status )
+{
+    int i, bad = 0;
+
+    // series of declarations in an attempt to avoid problem with
+    // goto fail
+    const int MXLEN=32;
+    char type[MXLEN+1];
+    size_t nbyte;
+    int typenum, npix, nelem = 0;
+    PyArrayObject* arr = NULL;
+    void *pntr[1];
+
+    if(nan && !copy){
+	PyErr_SetString(PyExc_ValueError, "ndf_read error: cannot translate bad values without copying");
+	return NULL;
+    }
+
+    // Get dimensions, number of elements and data type
+    const int NDIMX = 10;
+    int idim[NDIMX];
+    npy_intp rdim[NDIMX];
+
+    int ndim;
+    if(mtype != NULL){
+	strncpy(type, mtype, MXLEN);
+	type[MXLEN] = '\0';
+    }
+    STAR_BEGIN
+    ndfDim(*indf, NDIMX, idim, &ndim, status);
+    ndfSize(*indf, &npix, status);
+    if(mtype == NULL) ndfType(*indf, comp, type, MXLEN+1, status);
+    STAR_END
+    if (*status != SAI__OK) return NULL;
+
+    // Reverse order to account for C vs Fortran
+    for(i=0; i<ndim; i++) rdim[i] = idim[ndim-i-1];
+
+    // Work out the numpy type of the array to save data to
+    typenum = ndftype2npy(type, &nbyte);
+    if(typenum < 0){
+	PyErr_SetString(PyExc_IOError, "ndf_read error: unrecognised data type");
+	return NULL;
+    }
+
+    if(!copy){
+	STAR_BEGIN
+	ndfMap(*indf, comp, type, "READ", pntr, &nelem, status);
+	STAR_END
+	if(*status != SAI__OK) return NULL;
+	if(nelem != npix){
+	    PyErr_SetString(PyExc_IOError, "ndf_read error: number of elements different from number expected");
+	    return NULL;
+	}
+	return NDF_wrap_mapped(indf, NULL, 0, ndim, rdim, typenum, pntr[0], 0);
+    }
+
+    // allocate space, map, store, unmap. The bad pixel flag tells us
+    // whether there is any need to look for bad values at all.
+    arr = (PyArrayObject*) PyArray_SimpleNew(ndim, rdim, typenum);
+    if(arr == NULL) return NULL;
+    STAR_BEGIN
+    if(nan && (typenum == NPY_FLOAT || typenum == NPY_DOUBLE))
+	ndfBad(*indf, comp, 0, &bad, status);
+    ndfMap(*indf, comp, type, "READ", pntr, &nelem, status);
+    STAR_MAPPED(nelem*nbyte)
+    if(*status == SAI__OK && nelem == npix){
+	STAR_COPY_BEGIN
+	if(bad && typenum == NPY_FLOAT)
+	    bad2nan_f((float *)pntr[0], (float *)arr->data, npix, VAL__BADR);
+	else if(bad && typenum == NPY_DOUBLE)
+	    bad2nan_d((double *)pntr[0], (double *)arr->data, npix, VAL__BADD);
+	else
+	    memcpy(arr->data, pntr[0], npix*nbyte);
+	STAR_COPY_END(npix*nbyte)
+    }
+    ndfUnmap(*indf, comp, status);
+    STAR_UNMAPPED(nelem*nbyte)
+    STAR_END
+    if(*status != SAI__OK) goto fail;
+    if(nelem != npix){
+	PyErr_SetString(PyExc_IOError, "ndf_read error: number of elements different from number expected");
+	goto fail;
+    }
+
+    return PyArray_Return(arr);
+
+fail:
+    Py_XDECREF(arr);
+    return NULL;
+}
+
+// Reads an NDF into a numpy array. By default the data are copied; with
+// copy=False the array views the mapped component directly.
+static PyObject* 
+pyndf_read(NDF *self, PyObject *args, PyObject *kwds)
+{
+    STAR_ENTRY
+    int copy = 1, nan = 0;
+    const char *comp, *mtype = NULL;
+    PyObject *otype = Py_None;
+    static char *kwlist[] = {"comp", "type", "copy", "nan", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "s|Oii:pyndf_read", kwlist,
+                                    &comp, &otype, &copy, &nan))
+	return NULL;
+    if(otype != Py_None && (mtype = ndf_typearg(otype)) == NULL)
+	return NULL;
+
+    // Return None if component does not exist. A view is given its own
+    // identifier so that the mapping can outlive this call.
+    int state, status = SAI__OK;
+    int indf = self->_ndfid;
+    errBegin(&status);
+    STAR_BEGIN
     ndfState(self->_ndfid, comp, &state, &status);
+    if(state && !copy) ndfClone(self->_ndfid, &indf, &status);
+    STAR_END
     if (raiseNDFException(&status)) return NULL;
     if(!state)
 	Py_RETURN_NONE;
 
-    PyArrayObject* arr = NULL;
+    PyObject *arr = NDF_read_component(&indf, comp, mtype, copy, nan, &status);
+    if(!copy && indf != NDF__NOID){
+	STAR_BEGIN
+	ndfAnnul(&indf, &status);
+	STAR_END
+    }
+    if (raiseNDFException(&status)) {
+	Py_XDECREF(arr);
+	return NULL;
+    }
+    return arr;
+};
+
+// Reads several array components in one go. DATA, VARIANCE and ERROR
+// are mapped together through a comma-separated list and so share a
+// type; QUALITY can only be mapped as _UBYTE so is mapped on its own.
+// The state, dimensions and size are looked up once for all of them.
+static PyObject*
+pyndf_read_many(NDF *self, PyObject *args, PyObject *kwds)
+{
+    STAR_ENTRY
+    int nan = 0;
+    const char *mtype = NULL;
+    PyObject *ocomps, *otype = Py_None;
+    static char *kwlist[] = {"comps", "type", "nan", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|Oi:pyndf_read_many", kwlist,
+                                    &ocomps, &otype, &nan))
+	return NULL;
+    if(otype != Py_None && (mtype = ndf_typearg(otype)) == NULL)
+	return NULL;
+
+    // series of declarations in an attempt to avoid problem with
+    // goto fail
+    const int MXCOMP = 8, MXLEN = 32;
+    const char *comps[MXCOMP];
+    int i, j, n, nlist = 0, iqual = -1;
+    int icomp[MXCOMP];
+    int state[MXCOMP], ilist[MXCOMP], bad[MXCOMP];
+    char list[MXCOMP*(DAT__SZNAM+1)+1], type[MXLEN+1];
+    PyArrayObject* arr[MXCOMP];
+    PyObject *seq = NULL, *result = NULL;
+    void *pntr[MXCOMP];
+    size_t nbyte;
+    int typenum = 0, npix = 0, nelem = 0, ndim = 0;
+    int status = SAI__OK;
 
-    // Get dimensions, reverse order to account for C vs Fortran
     const int NDIMX = 10;
     int idim[NDIMX];
     npy_intp rdim[NDIMX];
 
-    int ndim;
+    for(i=0; i<MXCOMP; i++) arr[i] = NULL;
+    seq = PySequence_Fast(ocomps, "read_many: comps must be a sequence of component names");
+    if(seq == NULL) return NULL;
+    n = PySequence_Fast_GET_SIZE(seq);
+    if(n > MXCOMP){
+	PyErr_SetString(PyExc_ValueError, "read_many: too many components");
+	goto fail;
+    }
+    for(i=0; i<n; i++){
+	PyObject *item = PySequence_Fast_GET_ITEM(seq, i);
+#ifdef USE_PY3K
+	comps[i] = PyUnicode_Check(item) ? PyUnicode_AsUTF8(item) : NULL;
+#else
+	comps[i] = PyString_Check(item) ? PyString_AsString(item) : NULL;
+#endif
+	if(comps[i] == NULL || strlen(comps[i]) == 0 || strlen(comps[i]) > DAT__SZNAM){
+	    if(!PyErr_Occurred())
+		PyErr_SetString(PyExc_ValueError, "read_many: components must be given as names");
+	    goto fail;
+	}
+	// NDF cannot map the same array twice at once
+	if((icomp[i] = ndf_viewindex(comps[i])) < 0){
+	    PyErr_Format(PyExc_ValueError, "read_many: %s is not an array component", comps[i]);
+	    goto fail;
+	}
+	for(j=0; j<i; j++){
+	    if(icomp[j] == icomp[i]){
+		PyErr_Format(PyExc_ValueError, "read_many: %s and %s are the same array", comps[j], comps[i]);
+		goto fail;
+	    }
+	}
+    }
+
+    errBegin(&status);
+    STAR_BEGIN
     ndfDim(self->_ndfid, NDIMX, idim, &ndim, &status);
-    if (status != SAI__OK) goto fail; 
+    ndfSize(self->_ndfid, &npix, &status);
+    list[0] = '\0';
+    for(i=0; i<n; i++){
+	ndfState(self->_ndfid, comps[i], &state[i], &status);
+	if(status != SAI__OK || !state[i]) continue;
+	if(ndf_compmatch(comps[i], "QUALITY")){
+	    iqual = i;
+	}else{
+	    if(nlist) strcat(list, ",");
+	    strcat(list, comps[i]);
+	    ilist[nlist++] = i;
+	}
+    }
+    if(nlist){
+	if(mtype == NULL){
+	    ndfType(self->_ndfid, list, type, MXLEN+1, &status);
+	}else{
+	    strncpy(type, mtype, MXLEN);
+	    type[MXLEN] = '\0';
+	}
+    }
+    STAR_END
+    if (raiseNDFException(&status)) goto fail;
 
     // Reverse order to account for C vs Fortran
     for(i=0; i<ndim; i++) rdim[i] = idim[ndim-i-1];
 
-    // Determine the data type
-    ndfType(self->_ndfid, comp, type, MXLEN+1, &status);
-    if(status != SAI__OK) goto fail;
+    // Allocate space for everything before mapping any of it
+    if(nlist){
+	typenum = ndftype2npy(type, &nbyte);
+	if(typenum < 0){
+	    PyErr_SetString(PyExc_IOError, "read_many error: unrecognised data type");
+	    goto fail;
+	}
+	for(i=0; i<nlist; i++){
+	    arr[ilist[i]] = (PyArrayObject*) PyArray_SimpleNew(ndim, rdim, typenum);
+	    if(arr[ilist[i]] == NULL) goto fail;
+	}
+    }
+    if(iqual >= 0){
+	arr[iqual] = (PyArrayObject*) PyArray_SimpleNew(ndim, rdim, NPY_UBYTE);
+	if(arr[iqual] == NULL) goto fail;
+    }
 
-    // Create array of correct dimensions and type to save data to
-    if(strcmp(type, "_REAL") == 0){
-	arr = (PyArrayObject*) PyArray_SimpleNew(ndim, rdim, PyArray_FLOAT);
-	nbyte = sizeof(float);
-    }else if(strcmp(type, "_DOUBLE") == 0){
-	arr = (PyArrayObject*) PyArray_SimpleNew(ndim, rdim, PyArray_DOUBLE);
-	nbyte = sizeof(double);
-    }else if(strcmp(type, "_INTEGER") == 0){
-	arr = (PyArrayObject*) PyArray_SimpleNew(ndim, rdim, PyArray_INT);
-	nbyte = sizeof(int);
-    }else{
-	PyErr_SetString(PyExc_IOError, "ndf_read error: unrecognised data type");
+    STAR_BEGIN
+    if(nlist){
+	for(i=0; i<nlist; i++){
+	    bad[i] = 0;
+	    if(nan && (typenum == NPY_FLOAT || typenum == NPY_DOUBLE))
+		ndfBad(self->_ndfid, comps[ilist[i]], 0, &bad[i], &status);
+	}
+	ndfMap(self->_ndfid, list, type, "READ", pntr, &nelem, &status);
+	STAR_MAPPED(nlist*nelem*nbyte)
+	if(status == SAI__OK && nelem == npix){
+	    STAR_COPY_BEGIN
+	    for(i=0; i<nlist; i++){
+		void *data = arr[ilist[i]]->data;
+		if(bad[i] && typenum == NPY_FLOAT)
+		    bad2nan_f((float *)pntr[i], (float *)data, npix, VAL__BADR);
+		else if(bad[i] && typenum == NPY_DOUBLE)
+		    bad2nan_d((double *)pntr[i], (double *)data, npix, VAL__BADD);
+		else
+		    memcpy(data, pntr[i], npix*nbyte);
+	    }
+	    STAR_COPY_END(nlist*npix*nbyte)
+	}
+	ndfUnmap(self->_ndfid, list, &status);
+	STAR_UNMAPPED(nlist*nelem*nbyte)
+    }
+    if(iqual >= 0 && status == SAI__OK && (nlist == 0 || nelem == npix)){
+	ndfMap(self->_ndfid, comps[iqual], "_UBYTE", "READ", pntr, &nelem, &status);
+	STAR_MAPPED(nelem)
+	if(status == SAI__OK && nelem == npix){
+	    STAR_COPY_BEGIN
+	    memcpy(arr[iqual]->data, pntr[0], npix);
+	    STAR_COPY_END(npix)
+	}
+	ndfUnmap(self->_ndfid, comps[iqual], &status);
+	STAR_UNMAPPED(nelem)
+    }
+    STAR_END
+    if (raiseNDFException(&status)) goto fail;
+    if((nlist || iqual >= 0) && nelem != npix){
+	PyErr_SetString(PyExc_IOError, "read_many error: number of elements different from number expected");
 	goto fail;
     }
-    if(arr == NULL) goto fail;
 
-    // get number of elements, allocate space, map, store
+    // Absent components are returned as None
+    result = PyDict_New();
+    if(result == NULL) goto fail;
+    for(i=0; i<n; i++){
+	PyObject *value = arr[i] ? PyArray_Return(arr[i]) : (Py_INCREF(Py_None), Py_None);
+	arr[i] = NULL;
+	if(PyDict_SetItem(result, PySequence_Fast_GET_ITEM(seq, i), value) < 0){
+	    Py_DECREF(value);
+	    goto fail;
+	}
+	Py_DECREF(value);
+    }
+    Py_DECREF(seq);
+    return result;
 
-    ndfSize(self->_ndfid, &npix, &status);
-    if(status != SAI__OK) goto fail;
+fail:
+    for(i=0; i<MXCOMP; i++) Py_XDECREF(arr[i]);
+    Py_XDECREF(seq);
+    Py_XDECREF(result);
+    return NULL;
+};
+
+// Maps array component comp of an NDF a chunk of at most mxpix pixels at
+// a time and passes each chunk to func, with its dimensions and offset
+// from the start of the array (C order). Chunks are mapped as _DOUBLE
+// when the component is _DOUBLE, _INTEGER or _INT64, which a _REAL cannot
+// hold exactly, and as _REAL otherwise, dbl telling func which. Even a
+// _DOUBLE only holds integers exactly up to 2**53, so larger _INT64
+// values are rounded as they are mapped. func is
+// called with the GIL released and without the Starlink lock; it returns
+// 0 to carry on or -1 to stop. Returns the last value func returned, with
+// any Starlink error left in status.
+
+typedef int (*NDF_chunk_func)(void *data, const void *ptr, int dbl, int ndim,
+                              const size_t *cdim, const size_t *coff);
+
+static int
+NDF_stream_chunks( int indf, const char *comp, int mxpix, NDF_chunk_func func,
+                   void *data, int *status )
+{
+    const int MXLEN=32;
+    char type[MXLEN+1];
+    int i, k, ndim = 0, nchunk = 0, nelem, ret = 0;
+    int lbnd[NDF__MXDIM], ubnd[NDF__MXDIM];
+    size_t cdim[NDF__MXDIM], coff[NDF__MXDIM];
     void *pntr[1];
-    ndfMap(self->_ndfid, comp, type, "READ", pntr, &nelem, &status);
-    if(status != SAI__OK) goto fail;
-    if(nelem != npix){
-	PyErr_SetString(PyExc_IOError, "ndf_read error: number of elements different from number expected");
+
+    STAR_BEGIN
+    ndfType(indf, comp, type, MXLEN+1, status);
+    ndfBound(indf, NDF__MXDIM, lbnd, ubnd, &ndim, status);
+    ndfNchnk(indf, mxpix, &nchunk, status);
+    STAR_END
+    if(*status != SAI__OK) return 0;
+
+    int dbl = strcmp(type, "_DOUBLE") == 0 || strcmp(type, "_INTEGER") == 0 ||
+	strcmp(type, "_INT64") == 0;
+    const char *mtype = dbl ? "_DOUBLE" : "_REAL";
+    size_t nbyte = dbl ? sizeof(double) : sizeof(float);
+
+    for(i=1; i<=nchunk && ret == 0; i++){
+	int ichk = NDF__NOID, clbnd[NDF__MXDIM], cubnd[NDF__MXDIM];
+	nelem = 0;
+	STAR_BEGIN
+	ndfChunk(indf, mxpix, i, &ichk, status);
+	ndfBound(ichk, NDF__MXDIM, clbnd, cubnd, &ndim, status);
+	ndfMap(ichk, comp, mtype, "READ", pntr, &nelem, status);
+	STAR_MAPPED(nelem*nbyte)
+	STAR_END
+
+	if(*status == SAI__OK){
+	    for(k=0; k<ndim; k++){
+		coff[k] = clbnd[ndim-k-1] - lbnd[ndim-k-1];
+		cdim[k] = cubnd[ndim-k-1] - clbnd[ndim-k-1] + 1;
+	    }
+	    Py_BEGIN_ALLOW_THREADS
+	    ret = func(data, pntr[0], dbl, ndim, cdim, coff);
+	    Py_END_ALLOW_THREADS
+	}
+
+	STAR_BEGIN
+	if(ichk != NDF__NOID) ndfAnnul(&ichk, status);
+	STAR_UNMAPPED(nelem*nbyte)
+	STAR_END
+	if(*status != SAI__OK) break;
+    }
+    return ret;
+}
+
+// Adds a chunk into the output of read_binned
+
+typedef struct {
+    int method;
+    const size_t *fac, *odim;
+    double *out;
+    size_t *count;
+} NDF_bin_data;
+
+static int
+NDF_bin_chunk( void *data, const void *ptr, int dbl, int ndim,
+               const size_t *cdim, const size_t *coff )
+{
+    NDF_bin_data *bin = (NDF_bin_data *)data;
+    if(dbl)
+	bin_chunk_d((const double *)ptr, VAL__BADD, ndim, cdim, coff, bin->fac, bin->odim,
+		    bin->method, bin->out, bin->count);
+    else
+	bin_chunk_f((const float *)ptr, VAL__BADR, ndim, cdim, coff, bin->fac, bin->odim,
+		    bin->method, bin->out, bin->count);
+    return 0;
+}
+
+// Reads an array component reduced in size by binning blocks of pixels.
+// The component is streamed a chunk at a time and each chunk is added
+// into the output, so only the output itself and one chunk are ever held
+// in memory.
+static PyObject*
+pyndf_read_binned(NDF *self, PyObject *args, PyObject *kwds)
+{
+    STAR_ENTRY
+    const char *comp, *smethod = "mean";
+    PyObject *ofac, *seq = NULL;
+    int mxpix = 1 << 20;
+    static char *kwlist[] = {"comp", "factors", "method", "max_elements", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "sO|si:pyndf_read_binned", kwlist,
+                                    &comp, &ofac, &smethod, &mxpix))
+	return NULL;
+
+    int method;
+    if(strcmp(smethod, "mean") == 0){
+	method = BIN_MEAN;
+    }else if(strcmp(smethod, "sum") == 0){
+	method = BIN_SUM;
+    }else if(strcmp(smethod, "max") == 0){
+	method = BIN_MAX;
+    }else{
+	PyErr_SetString(PyExc_ValueError, "read_binned: method must be 'mean', 'sum' or 'max'");
+	return NULL;
+    }
+    if(mxpix < 1){
+	PyErr_SetString(PyExc_ValueError, "read_binned: max_elements must be at least 1");
+	return NULL;
+    }
+
+    int k, state, ndim = 0;
+    int lbnd[NDF__MXDIM], ubnd[NDF__MXDIM];
+    size_t fac[BIN_MXDIM], odim[BIN_MXDIM];
+    npy_intp rdim[BIN_MXDIM];
+    size_t nout = 1, *count = NULL;
+    PyArrayObject *out = NULL;
+
+    int status = SAI__OK;
+    errBegin(&status);
+    STAR_BEGIN
+    ndfState(self->_ndfid, comp, &state, &status);
+    if(state) ndfBound(self->_ndfid, NDF__MXDIM, lbnd, ubnd, &ndim, &status);
+    STAR_END
+    if (raiseNDFException(&status))
+	return NULL;
+    if(!state)
+	Py_RETURN_NONE;
+
+    // factors come in C order, or as one number for all axes
+    if(PySequence_Check(ofac)){
+	seq = PySequence_Fast(ofac, "read_binned: factors must be a number or a sequence");
+	if(seq == NULL) return NULL;
+	if(PySequence_Fast_GET_SIZE(seq) != ndim){
+	    PyErr_SetString(PyExc_ValueError, "read_binned: need one factor per dimension");
+	    goto fail;
+	}
+    }
+    for(k=0; k<ndim; k++){
+	long f = PyInt_AsLong(seq ? PySequence_Fast_GET_ITEM(seq, k) : ofac);
+	if(f == -1 && PyErr_Occurred()) goto fail;
+	if(f < 1){
+	    PyErr_SetString(PyExc_ValueError, "read_binned: factors must be at least 1");
+	    goto fail;
+	}
+	fac[k] = f;
+	odim[k] = (ubnd[ndim-k-1] - lbnd[ndim-k-1] + f)/f;
+	rdim[k] = odim[k];
+	nout *= odim[k];
+    }
+    Py_CLEAR(seq);
+
+    out = (PyArrayObject*) PyArray_ZEROS(ndim, rdim, NPY_DOUBLE, 0);
+    count = calloc(nout, sizeof(size_t));
+    if(out == NULL || count == NULL){
+	if(count == NULL) PyErr_NoMemory();
 	goto fail;
     }
-    memcpy(arr->data, pntr[0], npix*nbyte);
-    ndfUnmap(self->_ndfid, comp, &status);
-    if(status != SAI__OK) goto fail;
 
-    return Py_BuildValue("N", PyArray_Return(arr));
+    NDF_bin_data bin = {method, fac, odim, (double *)PyArray_DATA(out), count};
+    int ret = NDF_stream_chunks(self->_ndfid, comp, mxpix, NDF_bin_chunk, &bin, &status);
+    if (raiseNDFException(&status))
+	goto fail;
+    if(ret < 0){
+	PyErr_NoMemory();
+	goto fail;
+    }
+
+    bin_finish(method, (double *)PyArray_DATA(out), count, nout);
+    free(count);
+    return PyArray_Return(out);
 
 fail:
-    raiseNDFException(&status);
-    Py_XDECREF(arr);
+    Py_XDECREF(seq);
+    Py_XDECREF(out);
+    free(count);
+    return NULL;
+};
+
+// Adds a chunk into the accumulators of statistics
+
+typedef struct {
+    int axis;
+    stat_pool *pool;
+    const size_t *dim;
+    stat_acc *acc;
+} NDF_stat_data;
+
+static int
+NDF_stat_chunk( void *data, const void *ptr, int dbl, int ndim,
+                const size_t *cdim, const size_t *coff )
+{
+    NDF_stat_data *st = (NDF_stat_data *)data;
+    return stat_chunk(ptr, dbl, dbl ? VAL__BADD : VAL__BADR, ndim, cdim, coff,
+		      st->dim, st->axis, st->pool, st->acc);
+}
+
+// Computes statistics of the good values of an array component, either
+// overall or along one axis, streaming the component a chunk at a time.
+// The result is a dictionary of numbers or of arrays.
+static PyObject*
+pyndf_statistics(NDF *self, PyObject *args, PyObject *kwds)
+{
+    STAR_ENTRY
+    const char *comp;
+    PyObject *oaxis = Py_None, *result = NULL;
+    int mxpix = 1 << 20, nthread = 0;
+    static char *kwlist[] = {"comp", "axis", "max_elements", "nthread", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "s|Oii:pyndf_statistics", kwlist,
+                                    &comp, &oaxis, &mxpix, &nthread))
+	return NULL;
+    if(mxpix < 1){
+	PyErr_SetString(PyExc_ValueError, "statistics: max_elements must be at least 1");
+	return NULL;
+    }
+    if(nthread < 1){
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	nthread = ncpu > 0 ? ncpu : 1;
+    }
+
+    int i, k, state, ndim = 0, axis = -1, nodim = 0;
+    int lbnd[NDF__MXDIM], ubnd[NDF__MXDIM];
+    size_t j, dim[NDF__MXDIM], nacc = 1, nper = 1;
+    npy_intp odim[NDF__MXDIM];
+    stat_acc *acc = NULL;
+    PyArrayObject *arr[6] = {NULL, NULL, NULL, NULL, NULL, NULL};
+    static const char *names[6] = {"count", "bad", "mean", "std", "min", "max"};
+
+    int status = SAI__OK;
+    errBegin(&status);
+    STAR_BEGIN
+    ndfState(self->_ndfid, comp, &state, &status);
+    if(state) ndfBound(self->_ndfid, NDF__MXDIM, lbnd, ubnd, &ndim, &status);
+    STAR_END
+    if (raiseNDFException(&status))
+	return NULL;
+    if(!state)
+	Py_RETURN_NONE;
+
+    if(oaxis != Py_None){
+	axis = PyInt_AsLong(oaxis);
+	if(axis == -1 && PyErr_Occurred()) return NULL;
+	if(axis < 0) axis += ndim;
+	if(axis < 0 || axis >= ndim){
+	    PyErr_SetString(PyExc_ValueError, "statistics: axis out of range");
+	    return NULL;
+	}
+    }
+    for(k=0; k<ndim; k++){
+	dim[k] = ubnd[ndim-k-1] - lbnd[ndim-k-1] + 1;
+	if(axis < 0 || k == axis){
+	    nper *= dim[k];
+	}else{
+	    odim[nodim++] = dim[k];
+	    nacc *= dim[k];
+	}
+    }
+
+    // the threads are started once for all the chunks
+    acc = calloc(nacc, sizeof(stat_acc));
+    NDF_stat_data st = {axis, NULL, dim, acc};
+    if(acc == NULL || (st.pool = stat_pool_new(nthread)) == NULL){
+	free(acc);
+	PyErr_NoMemory();
+	return NULL;
+    }
+    int ret = NDF_stream_chunks(self->_ndfid, comp, mxpix, NDF_stat_chunk, &st, &status);
+    stat_pool_free(st.pool);
+    if (raiseNDFException(&status))
+	goto fail;
+    if(ret < 0){
+	PyErr_NoMemory();
+	goto fail;
+    }
+
+    // count is of the good values, bad of the rest; statistics of no
+    // values are NaN
+    for(i=0; i<6; i++)
+	if((arr[i] = (PyArrayObject*) PyArray_SimpleNew(nodim, odim, i < 2 ? NPY_INT64 : NPY_DOUBLE)) == NULL)
+	    goto fail;
+    npy_int64 *count = (npy_int64 *)PyArray_DATA(arr[0]), *nbad = (npy_int64 *)PyArray_DATA(arr[1]);
+    double *mean = (double *)PyArray_DATA(arr[2]), *std = (double *)PyArray_DATA(arr[3]);
+    double *vmin = (double *)PyArray_DATA(arr[4]), *vmax = (double *)PyArray_DATA(arr[5]);
+    for(j=0; j<nacc; j++){
+	count[j] = acc[j].n;
+	nbad[j] = nper - count[j];
+	if(acc[j].n > 0.){
+	    mean[j] = acc[j].mean;
+	    std[j] = sqrt(acc[j].m2/acc[j].n);
+	    vmin[j] = acc[j].min;
+	    vmax[j] = acc[j].max;
+	}else{
+	    mean[j] = std[j] = vmin[j] = vmax[j] = NAN;
+	}
+    }
+    free(acc);
+    acc = NULL;
+
+    result = PyDict_New();
+    if(result == NULL) goto fail;
+    for(i=0; i<6; i++){
+	PyObject *value = PyArray_Return(arr[i]);
+	arr[i] = NULL;
+	if(PyDict_SetItemString(result, names[i], value) < 0){
+	    Py_DECREF(value);
+	    goto fail;
+	}
+	Py_DECREF(value);
+    }
+    return result;
+
+fail:
+    for(i=0; i<6; i++) Py_XDECREF(arr[i]);
+    Py_XDECREF(result);
+    free(acc);
     return NULL;
 };
 
+// Adds a chunk into a quantile sketch
+
+static int
+NDF_sketch_chunk( void *data, const void *ptr, int dbl, int ndim,
+                  const size_t *cdim, const size_t *coff )
+{
+    size_t k, n = 1;
+    for(k=0; k<ndim; k++) n *= cdim[k];
+    return kll_add((kll_sketch *)data, ptr, dbl, dbl ? VAL__BADD : VAL__BADR, n);
+}
+
+// Adds the good values of an array component to a quantile sketch, a new
+// one unless one is given, in one pass over the component.
+static PyObject*
+pyndf_sketch(NDF *self, PyObject *args, PyObject *kwds)
+{
+    STAR_ENTRY
+    const char *comp;
+    PyObject *osketch = Py_None;
+    int k = 200, mxpix = 1 << 20;
+    static char *kwlist[] = {"comp", "k", "sketch", "max_elements", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "s|iOi:pyndf_sketch", kwlist,
+                                    &comp, &k, &osketch, &mxpix))
+	return NULL;
+    if(mxpix < 1){
+	PyErr_SetString(PyExc_ValueError, "sketch: max_elements must be at least 1");
+	return NULL;
+    }
+
+    NDFSketch *sketch;
+    if(osketch == Py_None){
+	sketch = (NDFSketch *)PyObject_CallFunction((PyObject *)&NDFSketchType, "i", k);
+	if(sketch == NULL) return NULL;
+    }else if(PyObject_TypeCheck(osketch, &NDFSketchType)){
+	sketch = (NDFSketch *)osketch;
+	Py_INCREF(sketch);
+    }else{
+	PyErr_SetString(PyExc_TypeError, "sketch: sketch must be a Sketch");
+	return NULL;
+    }
+    if(sketch->_busy){
+	PyErr_SetString(PyExc_RuntimeError, "sketch: sketch is already being added to");
+	Py_DECREF(sketch);
+	return NULL;
+    }
+
+    int state, ret = 0, status = SAI__OK;
+    errBegin(&status);
+    STAR_BEGIN
+    ndfState(self->_ndfid, comp, &state, &status);
+    STAR_END
+    if(state && status == SAI__OK){
+	sketch->_busy = 1;
+	ret = NDF_stream_chunks(self->_ndfid, comp, mxpix, NDF_sketch_chunk, &sketch->_sk, &status);
+	sketch->_busy = 0;
+    }
+    if (raiseNDFException(&status) || ret < 0 || !state) {
+	Py_DECREF(sketch);
+	if(ret < 0) return PyErr_NoMemory();
+	if(status != SAI__OK) return NULL;
+	Py_RETURN_NONE;
+    }
+    return (PyObject *)sketch;
+};
+
+// Adds a chunk into a histogram
+
+typedef struct {
+    double lo, hi;
+    size_t nbin;
+    unsigned long long *counts;
+} NDF_hist_data;
+
+static int
+NDF_hist_chunk( void *data, const void *ptr, int dbl, int ndim,
+                const size_t *cdim, const size_t *coff )
+{
+    NDF_hist_data *hist = (NDF_hist_data *)data;
+    size_t k, n = 1;
+    for(k=0; k<ndim; k++) n *= cdim[k];
+    hist_chunk(ptr, dbl, dbl ? VAL__BADD : VAL__BADR, n, hist->lo, hist->hi,
+	       hist->nbin, hist->counts);
+    return 0;
+}
+
+// Computes a histogram of the good values of an array component in equal
+// bins. Without a range, a first pass finds the extremes of the values.
+static PyObject*
+pyndf_histogram(NDF *self, PyObject *args, PyObject *kwds)
+{
+    STAR_ENTRY
+    const char *comp;
+    PyObject *orange = Py_None;
+    int i, nbin = 100, mxpix = 1 << 20;
+    double lo = 0., hi = 0.;
+    static char *kwlist[] = {"comp", "bins", "range", "max_elements", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "s|iOi:pyndf_histogram", kwlist,
+                                    &comp, &nbin, &orange, &mxpix))
+	return NULL;
+    if(nbin < 1 || mxpix < 1){
+	PyErr_SetString(PyExc_ValueError, "histogram: bins and max_elements must be at least 1");
+	return NULL;
+    }
+    if(orange != Py_None){
+	if(!PyArg_ParseTuple(orange, "dd:histogram range", &lo, &hi))
+	    return NULL;
+	if(!(hi > lo)){
+	    PyErr_SetString(PyExc_ValueError, "histogram: range must be increasing");
+	    return NULL;
+	}
+    }
+
+    int ret, state, status = SAI__OK;
+    errBegin(&status);
+    STAR_BEGIN
+    ndfState(self->_ndfid, comp, &state, &status);
+    STAR_END
+    if (raiseNDFException(&status))
+	return NULL;
+    if(!state)
+	Py_RETURN_NONE;
+
+    if(orange == Py_None){
+	size_t dim[1] = {0};
+	stat_acc acc;
+	memset(&acc, 0, sizeof(acc));
+	NDF_stat_data st = {-1, NULL, dim, &acc};
+	ret = NDF_stream_chunks(self->_ndfid, comp, mxpix, NDF_stat_chunk, &st, &status);
+	if (raiseNDFException(&status))
+	    return NULL;
+	if(ret < 0)
+	    return PyErr_NoMemory();
+	// as numpy does for no values, or all the same
+	lo = acc.n > 0. ? acc.min : 0.;
+	hi = acc.n > 0. ? acc.max : 1.;
+	if(lo == hi){
+	    lo -= 0.5;
+	    hi += 0.5;
+	}
+    }
+
+    npy_intp ncount = nbin, nedge = nbin+1;
+    PyArrayObject *counts = (PyArrayObject*) PyArray_ZEROS(1, &ncount, NPY_ULONGLONG, 0);
+    PyArrayObject *edges = (PyArrayObject*) PyArray_SimpleNew(1, &nedge, NPY_DOUBLE);
+    if(counts == NULL || edges == NULL) goto fail;
+    double *e = (double *)PyArray_DATA(edges);
+    for(i=0; i<=nbin; i++) e[i] = lo + (hi - lo)*i/nbin;
+
+    NDF_hist_data hist = {lo, hi, nbin, (unsigned long long *)PyArray_DATA(counts)};
+    ret = NDF_stream_chunks(self->_ndfid, comp, mxpix, NDF_hist_chunk, &hist, &status);
+    if (raiseNDFException(&status))
+	goto fail;
+    if(ret < 0){
+	PyErr_NoMemory();
+	goto fail;
+    }
+    return Py_BuildValue("NN", counts, edges);
+
+fail:
+    Py_XDECREF(counts);
+    Py_XDECREF(edges);
+    return NULL;
+};
+
+// Creates an iterator over the chunks of an array component
+static PyObject* 
+pyndf_iter_chunks(NDF *self, PyObject *args, PyObject *kwds)
+{
+    STAR_ENTRY
+    int mxpix, copy = 1, nan = 0;
+    const char *comp, *mtype = NULL;
+    PyObject *otype = Py_None;
+    static char *kwlist[] = {"comp", "max_elements", "type", "copy", "nan", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "si|Oii:pyndf_iter_chunks", kwlist,
+                                    &comp, &mxpix, &otype, &copy, &nan))
+	return NULL;
+    if(otype != Py_None && (mtype = ndf_typearg(otype)) == NULL)
+	return NULL;
+    if(nan && !copy){
+	PyErr_SetString(PyExc_ValueError, "iter_chunks: cannot translate bad values without copying");
+	return NULL;
+    }
+    if(mxpix < 1){
+	PyErr_SetString(PyExc_ValueError, "iter_chunks: max_elements must be at least 1");
+	return NULL;
+    }
+    if(strlen(comp) >= sizeof(((NDFChunkIter *)0)->_comp)){
+	PyErr_SetString(PyExc_ValueError, "iter_chunks: component name too long");
+	return NULL;
+    }
+
+    NDFChunkIter *iter = PyObject_New( NDFChunkIter, &NDFChunkIterType );
+    if(iter == NULL) return NULL;
+    iter->_ndfid = NDF__NOID;
+    strcpy(iter->_comp, comp);
+    iter->_mxpix = mxpix;
+    iter->_copy = copy;
+    iter->_type = mtype;
+    iter->_nan = nan;
+    iter->_ichunk = 1;
+
+    // Return None if component does not exist. The iterator works through
+    // a clone so that it is unaffected by anything done to this
+    // identifier meanwhile.
+    int state, status = SAI__OK;
+    int ubnd[NDF__MXDIM];
+    errBegin(&status);
+    STAR_BEGIN
+    ndfState(self->_ndfid, comp, &state, &status);
+    if(state){
+	ndfClone(self->_ndfid, &iter->_ndfid, &status);
+	ndfBound(iter->_ndfid, NDF__MXDIM, iter->_lbnd, ubnd, &iter->_ndim, &status);
+	ndfNchnk(iter->_ndfid, mxpix, &iter->_nchunk, &status);
+    }
+    STAR_END
+    if (raiseNDFException(&status) || !state) {
+	Py_DECREF(iter);
+	if(status != SAI__OK) return NULL;
+	Py_RETURN_NONE;
+    }
+    return (PyObject*)iter;
+};
 
 static PyObject* 
 pyndf_state(NDF *self, PyObject *args)
 {
+    STAR_ENTRY
     const char *comp;
     if(!PyArg_ParseTuple(args, "s:pyndf_state", &comp))
 	return NULL;
     int state, status = SAI__OK;
     errBegin(&status);
+    STAR_BEGIN
     ndfState(self->_ndfid, comp, &state, &status);
+    STAR_END
     if (raiseNDFException(&status)) return NULL;
     return Py_BuildValue("i", state);
 };
@@ -821,23 +2535,26 @@ pyndf_state(NDF *self, PyObject *args)
 static PyObject* 
 pyndf_xloc(NDF *self, PyObject *args)
 {
+    STAR_ENTRY
     const char *xname, *mode;
     if(!PyArg_ParseTuple(args, "ss:pyndf_xloc", &xname, &mode))
 	return NULL;
     HDSLoc* loc = NULL;
     int status = SAI__OK;
     errBegin(&status);
+    STAR_BEGIN
     ndfXloc(self->_ndfid, xname, mode, &loc, &status);
+    STAR_END
     if (raiseNDFException(&status)) return NULL;
 
     // PyCObject to pass pointer along to other wrappers
-    PyObject *pobj = NpyCapsule_FromVoidPtr(loc, PyDelLoc);
-    return Py_BuildValue("O", pobj);
+    return NpyCapsule_FromVoidPtr(loc, PyDelLoc);
 };
 
 static PyObject* 
 pyndf_xname(NDF *self, PyObject *args)
 {
+    STAR_ENTRY
     int nex, nlen = 32;
     if(!PyArg_ParseTuple(args, "i|i:pyndf_xname", &nex, &nlen))
 	return NULL;
@@ -845,7 +2562,9 @@ pyndf_xname(NDF *self, PyObject *args)
     char xname[nlen+1];
     int status = SAI__OK;
     errBegin(&status);
+    STAR_BEGIN
     ndfXname(self->_ndfid, nex+1, xname, nlen+1, &status);
+    STAR_END
     if (raiseNDFException(&status)) return NULL;
     return Py_BuildValue("s", xname);
 };
@@ -853,9 +2572,12 @@ pyndf_xname(NDF *self, PyObject *args)
 static PyObject* 
 pyndf_xnumb(NDF *self)
 {
+    STAR_ENTRY
     int status = SAI__OK, nextn;
     errBegin(&status);
+    STAR_BEGIN
     ndfXnumb(self->_ndfid, &nextn, &status);
+    STAR_END
     if (raiseNDFException(&status)) return NULL;
 
     return Py_BuildValue("i", nextn);
@@ -864,12 +2586,15 @@ pyndf_xnumb(NDF *self)
 static PyObject* 
 pyndf_xstat(NDF *self, PyObject *args)
 {
+    STAR_ENTRY
     const char *xname;
     if(!PyArg_ParseTuple(args, "si:pyndf_xstat", &xname))
 	return NULL;
     int state, status = SAI__OK;
     errBegin(&status);
+    STAR_BEGIN
     ndfXstat(self->_ndfid, xname, &state, &status);
+    STAR_END
     if (raiseNDFException(&status)) return NULL;
 
     return Py_BuildValue("i", state);
@@ -925,17 +2650,71 @@ static PyMethodDef NDF_methods[] = {
     {"cget", (PyCFunction)pyndf_cget, METH_VARARGS, 
      "value = indf.cget(comp) -- returns character component comp as a string, None if comp does not exist."},
 
+    {"delet", (PyCFunction)pyndf_delet, METH_NOARGS, 
+     "indf.delet() -- deletes the NDF, annulling the identifier and any others referring to it."},
+
     {"dim", (PyCFunction)pyndf_dim, METH_NOARGS, 
      "dim = indf.dim() -- returns dimensions as 1D array."},
 
     {"end", (PyCFunction)pyndf_end, METH_NOARGS, 
-     "ndf.end() -- ends the current NDF context."},
+     "ndf.end() -- ends the current NDF context, annulling its identifiers. Raises RuntimeError while arrays mapped through\n"
+     "them (by map, or read with copy=False) are alive."},
 
     {"open", (PyCFunction)pyndf_open, METH_VARARGS, 
      "indf = ndf.open(name) -- opens an NDF file."},
 
-    {"read", (PyCFunction)pyndf_read, METH_VARARGS, 
-     "arr = indf.read(comp) -- reads component comp of an NDF (e.g. dat or var). Returns None if it does not exist."},
+    {"info", (PyCFunction)pyndf_info, METH_VARARGS, 
+     "info = ndf.info(name) -- returns the shape, bound, type, title, label, units, extensions (names) and bad (pixel flag)\n"
+     "of an NDF without reading any of its arrays. The NDF is only open for the duration of the call."},
+
+    {"read", (PyCFunction)pyndf_read, METH_VARARGS | METH_KEYWORDS, 
+     "arr = indf.read(comp, type=None, copy=True, nan=False) -- reads component comp of an NDF (e.g. dat or var). Returns None if it does not exist.\n"
+     "type, an NDF type such as '_REAL' or a numpy dtype, selects the type of the array returned; the conversion is done as\n"
+     "the data are mapped. By default the component's own type is used. With nan=True, bad values in _REAL or _DOUBLE\n"
+     "data are replaced by NaN as the data are copied; this is skipped if the bad pixel flag says there are none.\n"
+     "With copy=False a read-only array is returned which views the mapped component without copying it. The component stays\n"
+     "mapped until the last reference to the array is gone; until then ndf.end() of the enclosing context raises RuntimeError."},
+
+    {"read_many", (PyCFunction)pyndf_read_many, METH_VARARGS | METH_KEYWORDS, 
+     "comps = indf.read_many(comps, type=None, nan=False) -- reads several components (e.g. ['DATA','VARIANCE','QUALITY']) at once,\n"
+     "returning a dictionary of arrays keyed by the names given, with None for any that do not exist. DATA, VARIANCE and ERROR\n"
+     "are mapped together and so are returned with a common type, the most precise of theirs unless type is given; QUALITY is\n"
+     "always _UBYTE. type and nan otherwise have the same meaning as for read. Names may be abbreviated to three characters;\n"
+     "ValueError is raised for anything but an array component, or for one named twice."},
+
+    {"read_binned", (PyCFunction)pyndf_read_binned, METH_VARARGS | METH_KEYWORDS,
+     "arr = indf.read_binned(comp, factors, method='mean', max_elements=1048576) -- reads array component comp reduced by\n"
+     "binning blocks of factors pixels, a sequence in C order or one number for all axes, e.g. for quick-look previews.\n"
+     "method is 'mean', 'sum' or 'max' of the good pixels of each block; blocks at the upper edges may be partial. Returns\n"
+     "a float64 array with NaN where a block has no good pixels, or None if comp does not exist. The component is read in\n"
+     "chunks of at most max_elements pixels, so only the result and one chunk are held at once. _INT64 data are read as\n"
+     "_DOUBLE, so values beyond 2**53 are rounded."},
+
+    {"statistics", (PyCFunction)pyndf_statistics, METH_VARARGS | METH_KEYWORDS,
+     "st = indf.statistics(comp, axis=None, max_elements=1048576, nthread=0) -- statistics of the good values of array\n"
+     "component comp, as a dictionary of count and bad (the numbers of good and bad values), mean, std (the standard\n"
+     "deviation, about the mean), min and max. These are numbers, or with axis (C order) arrays of the statistics along\n"
+     "that axis. NaN stands for a statistic of no values. Returns None if comp does not exist. The component is read in\n"
+     "chunks of at most max_elements pixels, shared between nthread threads, by default one per processor. _INT64 values\n"
+     "are converted to _DOUBLE as they are read, rounding any beyond 2**53."},
+
+    {"sketch", (PyCFunction)pyndf_sketch, METH_VARARGS | METH_KEYWORDS,
+     "sketch = indf.sketch(comp, k=200, sketch=None, max_elements=1048576) -- summarises the good values of array component\n"
+     "comp in a quantile Sketch of accuracy k, for medians and percentiles without loading the data. Given a sketch, adds\n"
+     "to that instead, so that one sketch can cover many NDFs. Returns None if comp does not exist. The component is read\n"
+     "once, in chunks of at most max_elements pixels, with _INT64 values rounded to _DOUBLE beyond 2**53."},
+
+    {"histogram", (PyCFunction)pyndf_histogram, METH_VARARGS | METH_KEYWORDS,
+     "(counts, edges) = indf.histogram(comp, bins=100, range=None, max_elements=1048576) -- histogram of the good values of\n"
+     "array component comp in bins equal bins, as numpy.histogram. range (lo, hi) defaults to the extremes of the values,\n"
+     "which takes an extra pass; with a fixed range, counts from several NDFs can simply be added. Returns None if comp\n"
+     "does not exist. The component is read in chunks of at most max_elements pixels. _INT64 data are read as _DOUBLE,\n"
+     "which rounds values beyond 2**53 and may move them between bins."},
+
+    {"iter_chunks", (PyCFunction)pyndf_iter_chunks, METH_VARARGS | METH_KEYWORDS, 
+     "it = indf.iter_chunks(comp, max_elements, type=None, copy=True, nan=False) -- iterates over component comp in chunks of at most max_elements\n"
+     "pixels, giving (offset, arr) for each where offset is the position of the chunk in the full array (C order). Returns\n"
+     "None if the component does not exist. type, copy and nan have the same meaning as for read."},
 
     {"state", (PyCFunction)pyndf_state, METH_VARARGS, 
      "state = indf.state(comp) -- determine the state of an NDF component."},
@@ -955,24 +2734,54 @@ static PyMethodDef NDF_methods[] = {
     {"new", (PyCFunction)pyndf_new, METH_VARARGS,
      "ondf = indf.new(ftype,ndim,lbnd,ubnd) -- create a new simple ndf structure."},
 
+    {"sbnd", (PyCFunction)pyndf_sbnd, METH_VARARGS,
+     "indf.sbnd(lbnd,ubnd) -- change the pixel bounds of an NDF, given in C order as returned by bound(). Pixels within both\n"
+     "the old and the new bounds keep their values; any others are bad."},
+
+    {"sect", (PyCFunction)pyndf_sect, METH_VARARGS,
+     "isect = indf.sect(lbnd,ubnd) -- create a section of an NDF with pixel bounds given in C order as returned by bound()."},
+
+    {"section", (PyCFunction)pyndf_section, METH_VARARGS,
+     "isect = indf.section(key) -- create a section of an NDF from a numpy-style key of integers and slices, in C order and\n"
+     "counted from the first pixel, e.g. indf.section((slice(10,20), slice(0,5))). Integers keep their axis, with a\n"
+     "single pixel, and steps are not allowed. indf[key] reads the data of such a selection directly, steps included."},
+
     {"xnew", (PyCFunction)pyndf_xnew, METH_VARARGS,
      "loc = indf.xnew(xname,type,ndim,dim) -- create a new ndf extension."},
 
     {"map", (PyCFunction)pyndf_map, METH_VARARGS,
-     "(pointer,elements) = indf.map(comp,type,mmod) -- map access to array component."},
+     "arr = indf.map(comp,type,mmod) -- map access to array component, returning a numpy array of NDF type type which views\n"
+     "the mapped data. The array is writeable unless mmod is READ, and changes made through it reach the NDF when the\n"
+     "component is unmapped. It keeps this object alive, and unmap and annul raise RuntimeError until it, and any arrays\n"
+     "derived from it, have been deleted; so does ndf.end() of the context the NDF was opened in."},
 
     {"unmap", (PyCFunction)pyndf_unmap, METH_VARARGS,
-     "status = indf.unmap(comp) -- unmap an NDF or mapped NDF array."},
+     "status = indf.unmap(comp) -- unmap an NDF or mapped NDF array ('*' for all). Arrays returned by map for comp must have\n"
+     "been deleted first."},
 
-    {"ndf_numpytoptr", (PyCFunction)pyndf_numpytoptr, METH_VARARGS,
-     "ndf_numpytoptr(array,pointer,elements,type) -- write numpy array to mapped pointer elements."},
+    {"write", (PyCFunction)pyndf_write, METH_VARARGS | METH_KEYWORDS,
+     "indf.write(comp, array, nan=False) -- write a numpy array to array component comp, whose shape it must match. The data are\n"
+     "converted to the component's type as they are copied into the mapped component. With nan=True, NaNs are replaced by\n"
+     "the bad value when the component is _REAL or _DOUBLE."},
+
+    {"ndf_numpytoptr", (PyCFunction)pyndf_numpytoptr, METH_VARARGS | METH_KEYWORDS,
+     "ndf_numpytoptr(array,pointer,elements,type,nan=False) -- write numpy array to mapped pointer (an array returned by map) elements.\n"
+     "With nan=True, NaNs in _REAL or _DOUBLE data are replaced by the bad value as they are copied."},
 
     {"ndf_getbadpixval", (PyCFunction)pyndf_getbadpixval, METH_VARARGS,
      "ndf_getbadpixval(type) -- return a bad pixel value for given ndf data type."},
 
+    STAR_STATS_METHODS
+
     {NULL, NULL, 0, NULL} /* Sentinel */
 };
 
+static PyMappingMethods NDF_as_mapping = {
+    0,                              /* mp_length */
+    (binaryfunc)NDF_subscript,      /* mp_subscript */
+    0,                              /* mp_ass_subscript */
+};
+
 static PyTypeObject NDFType = {
     PyVarObject_HEAD_INIT(NULL, 0)
     "starlink.ndf.api",             /* tp_name */
@@ -986,7 +2795,7 @@ static PyTypeObject NDFType = {
     0,                         /* tp_repr */
     0,                         /* tp_as_number */
     0,                         /* tp_as_sequence */
-    0,                         /* tp_as_mapping */
+    &NDF_as_mapping,           /* tp_as_mapping */
     0,                         /* tp_hash  */
     0,                         /* tp_call */
     0,                         /* tp_str */
@@ -1015,6 +2824,267 @@ static PyTypeObject NDFType = {
     NDF_new,                 /* tp_new */
 };
 
+static PyTypeObject NDFMappingType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "starlink.ndf.api.mapping",             /* tp_name */
+    sizeof(NDFMapping),             /* tp_basicsize */
+    0,                         /* tp_itemsize */
+    (destructor)NDFMapping_dealloc, /* tp_dealloc */
+    0,                         /* tp_print */
+    0,                         /* tp_getattr */
+    0,                         /* tp_setattr */
+    0,                         /* tp_reserved */
+    0,                         /* tp_repr */
+    0,                         /* tp_as_number */
+    0,                         /* tp_as_sequence */
+    0,                         /* tp_as_mapping */
+    0,                         /* tp_hash  */
+    0,                         /* tp_call */
+    0,                         /* tp_str */
+    0,                         /* tp_getattro */
+    0,                         /* tp_setattro */
+    0,                         /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,        /* tp_flags */
+    "Owner of a mapped NDF array component",           /* tp_doc */
+};
+
+static PyTypeObject NDFChunkIterType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "starlink.ndf.api.chunkiter",             /* tp_name */
+    sizeof(NDFChunkIter),             /* tp_basicsize */
+    0,                         /* tp_itemsize */
+    (destructor)NDFChunkIter_dealloc, /* tp_dealloc */
+    0,                         /* tp_print */
+    0,                         /* tp_getattr */
+    0,                         /* tp_setattr */
+    0,                         /* tp_reserved */
+    0,                         /* tp_repr */
+    0,                         /* tp_as_number */
+    0,                         /* tp_as_sequence */
+    0,                         /* tp_as_mapping */
+    0,                         /* tp_hash  */
+    0,                         /* tp_call */
+    0,                         /* tp_str */
+    0,                         /* tp_getattro */
+    0,                         /* tp_setattro */
+    0,                         /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,        /* tp_flags */
+    "Iterator over the chunks of an NDF array component",           /* tp_doc */
+    0,		               /* tp_traverse */
+    0,		               /* tp_clear */
+    0,		               /* tp_richcompare */
+    0,		               /* tp_weaklistoffset */
+    PyObject_SelfIter,	       /* tp_iter */
+    (iternextfunc)NDFChunkIter_iternext, /* tp_iternext */
+};
+
+// The quantile sketch type
+
+static PyObject *
+NDFSketch_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    int k = 200;
+    static char *kwlist[] = {"k", NULL};
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "|i:Sketch", kwlist, &k))
+	return NULL;
+    if(k < 8){
+	PyErr_SetString(PyExc_ValueError, "Sketch: k must be at least 8");
+	return NULL;
+    }
+    NDFSketch *self = (NDFSketch *) type->tp_alloc( type, 0 );
+    if (self != NULL) {
+	kll_init(&self->_sk, k);
+	self->_busy = 0;
+    }
+    return (PyObject *)self;
+}
+
+static void
+NDFSketch_dealloc(NDFSketch* self)
+{
+    kll_free(&self->_sk);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static int
+NDFSketch_check_idle(NDFSketch *self)
+{
+    if(self->_busy){
+	PyErr_SetString(PyExc_RuntimeError, "Sketch: sketch is being added to");
+	return -1;
+    }
+    return 0;
+}
+
+static PyObject *
+NDFSketch_quantile(NDFSketch *self, PyObject *args)
+{
+    PyObject *oq;
+    if(!PyArg_ParseTuple(args, "O:quantile", &oq))
+	return NULL;
+    if(NDFSketch_check_idle(self) < 0)
+	return NULL;
+    PyArrayObject *q = (PyArrayObject*) PyArray_FROM_OTF(oq, NPY_DOUBLE, NPY_IN_ARRAY | NPY_FORCECAST);
+    if(q == NULL) return NULL;
+    PyArrayObject *out = (PyArrayObject*) PyArray_SimpleNew(PyArray_NDIM(q), PyArray_DIMS(q), NPY_DOUBLE);
+    if(out == NULL){
+	Py_DECREF(q);
+	return NULL;
+    }
+    int ret = kll_quantiles(&self->_sk, (double *)PyArray_DATA(q), PyArray_SIZE(q),
+			    (double *)PyArray_DATA(out));
+    Py_DECREF(q);
+    if(ret < 0){
+	Py_DECREF(out);
+	return PyErr_NoMemory();
+    }
+    return PyArray_Return(out);
+}
+
+static PyObject *
+NDFSketch_merge(NDFSketch *self, PyObject *args)
+{
+    NDFSketch *other;
+    if(!PyArg_ParseTuple(args, "O!:merge", &NDFSketchType, &other))
+	return NULL;
+    if(other == self){
+	PyErr_SetString(PyExc_ValueError, "Sketch: cannot merge a sketch with itself");
+	return NULL;
+    }
+    if(NDFSketch_check_idle(self) < 0 || NDFSketch_check_idle(other) < 0)
+	return NULL;
+    if(kll_merge(&self->_sk, &other->_sk) < 0)
+	return PyErr_NoMemory();
+    Py_RETURN_NONE;
+}
+
+// Pickled as k and the state (n, min, max, [items of each level])
+
+static PyObject *
+NDFSketch_reduce(NDFSketch *self)
+{
+    int h;
+    if(NDFSketch_check_idle(self) < 0)
+	return NULL;
+    PyObject *levels = PyList_New(self->_sk.nlev);
+    if(levels == NULL) return NULL;
+    for(h=0; h<self->_sk.nlev; h++){
+	npy_intp len = self->_sk.len[h];
+	PyArrayObject *items = (PyArrayObject*) PyArray_SimpleNew(1, &len, NPY_DOUBLE);
+	if(items == NULL){
+	    Py_DECREF(levels);
+	    return NULL;
+	}
+	if(len) memcpy(PyArray_DATA(items), self->_sk.items[h], len*sizeof(double));
+	PyList_SET_ITEM(levels, h, (PyObject *)items);
+    }
+    return Py_BuildValue("O(i)(dddN)", Py_TYPE(self), self->_sk.k, self->_sk.n,
+			 self->_sk.min, self->_sk.max, levels);
+}
+
+static PyObject *
+NDFSketch_setstate(NDFSketch *self, PyObject *args)
+{
+    int h;
+    double n, vmin, vmax;
+    PyObject *levels, *seq;
+    if(!PyArg_ParseTuple(args, "(dddO):__setstate__", &n, &vmin, &vmax, &levels))
+	return NULL;
+    if(NDFSketch_check_idle(self) < 0)
+	return NULL;
+    seq = PySequence_Fast(levels, "Sketch: levels must be a sequence");
+    if(seq == NULL) return NULL;
+    if(PySequence_Fast_GET_SIZE(seq) > KLL_MXLEV){
+	PyErr_SetString(PyExc_ValueError, "Sketch: too many levels");
+	goto fail;
+    }
+
+    int k = self->_sk.k;
+    kll_free(&self->_sk);
+    kll_init(&self->_sk, k);
+    for(h=0; h<PySequence_Fast_GET_SIZE(seq); h++){
+	PyArrayObject *items = (PyArrayObject*) PyArray_FROM_OTF(PySequence_Fast_GET_ITEM(seq, h),
+								 NPY_DOUBLE, NPY_IN_ARRAY | NPY_FORCECAST);
+	if(items == NULL) goto fail;
+	int ret = kll_add_level(&self->_sk, h, (double *)PyArray_DATA(items), PyArray_SIZE(items));
+	Py_DECREF(items);
+	if(ret < 0){
+	    PyErr_NoMemory();
+	    goto fail;
+	}
+    }
+    self->_sk.n = n;
+    self->_sk.min = vmin;
+    self->_sk.max = vmax;
+    Py_DECREF(seq);
+    Py_RETURN_NONE;
+
+fail:
+    Py_DECREF(seq);
+    return NULL;
+}
+
+static PyMethodDef NDFSketch_methods[] = {
+    {"quantile", (PyCFunction)NDFSketch_quantile, METH_VARARGS,
+     "x = sketch.quantile(q) -- values at fractions q (a number or an array) of the way through the sorted values.\n"
+     "Ranks are good to about 1.7/k of the number of values; 0 and 1 give the exact extremes."},
+    {"merge", (PyCFunction)NDFSketch_merge, METH_VARARGS,
+     "sketch.merge(other) -- adds the values summarised by another sketch to this one."},
+    {"__reduce__", (PyCFunction)NDFSketch_reduce, METH_NOARGS, "Pickles the sketch."},
+    {"__setstate__", (PyCFunction)NDFSketch_setstate, METH_VARARGS, "Restores a pickled sketch."},
+    {NULL, NULL, 0, NULL} /* Sentinel */
+};
+
+static PyMemberDef NDFSketch_members[] = {
+    {"k", T_INT, offsetof(NDFSketch, _sk.k), READONLY, "accuracy parameter"},
+    {"n", T_DOUBLE, offsetof(NDFSketch, _sk.n), READONLY, "number of values summarised"},
+    {"min", T_DOUBLE, offsetof(NDFSketch, _sk.min), READONLY, "smallest value"},
+    {"max", T_DOUBLE, offsetof(NDFSketch, _sk.max), READONLY, "largest value"},
+    {NULL} /* Sentinel */
+};
+
+static PyTypeObject NDFSketchType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "starlink.ndf.api.Sketch",             /* tp_name */
+    sizeof(NDFSketch),             /* tp_basicsize */
+    0,                         /* tp_itemsize */
+    (destructor)NDFSketch_dealloc, /* tp_dealloc */
+    0,                         /* tp_print */
+    0,                         /* tp_getattr */
+    0,                         /* tp_setattr */
+    0,                         /* tp_reserved */
+    0,                         /* tp_repr */
+    0,                         /* tp_as_number */
+    0,                         /* tp_as_sequence */
+    0,                         /* tp_as_mapping */
+    0,                         /* tp_hash  */
+    0,                         /* tp_call */
+    0,                         /* tp_str */
+    0,                         /* tp_getattro */
+    0,                         /* tp_setattro */
+    0,                         /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,        /* tp_flags */
+    "Sketch(k=200) -- streaming quantile sketch, filled by indf.sketch(), which keeps O(k) values\n"
+    "however many it summarises. Sketches can be merged and pickled.",           /* tp_doc */
+    0,		               /* tp_traverse */
+    0,		               /* tp_clear */
+    0,		               /* tp_richcompare */
+    0,		               /* tp_weaklistoffset */
+    0,		               /* tp_iter */
+    0,		               /* tp_iternext */
+    NDFSketch_methods,         /* tp_methods */
+    NDFSketch_members,         /* tp_members */
+    0,                         /* tp_getset */
+    0,                         /* tp_base */
+    0,                         /* tp_dict */
+    0,                         /* tp_descr_get */
+    0,                         /* tp_descr_set */
+    0,                         /* tp_dictoffset */
+    0,                         /* tp_init */
+    0,                         /* tp_alloc */
+    NDFSketch_new,             /* tp_new */
+};
+
 // Helper to create an object with an NDF identifier and placeholder
 
 static PyObject *
@@ -1026,6 +3096,61 @@ NDF_create_object( int ndfid, int place )
   return (PyObject*)self;
 }
 
+// Helper to wrap memory mapped through identifier indf in a numpy array
+// of C-ordered dimensions rdim. The identifier is handed over to a
+// mapping object which becomes the array's base and annuls it when the
+// array goes away. *indf is reset to NDF__NOID whatever happens. If
+// owner is given, indf should be NDF__NOID and the mapping object keeps
+// owner alive instead, counting as a view of its component iview (see
+// ndf_viewindex) until the array goes away. Either way the array counts
+// as a view in the context of the identifier, which for *indf must be
+// the current one.
+
+static PyObject *
+NDF_wrap_mapped( int *indf, PyObject *owner, int iview, int ndim, npy_intp *rdim,
+                 int typenum, void *ptr, int writeable )
+{
+  PyArrayObject *arr = NULL;
+  NDFMapping *base = PyObject_New( NDFMapping, &NDFMappingType );
+  if (base == NULL) {
+    int status = SAI__OK;
+    errBegin(&status);
+    STAR_BEGIN
+    if (*indf != NDF__NOID) ndfAnnul( indf, &status );
+    STAR_END
+    if (status != SAI__OK) errAnnul(&status);
+    errEnd(&status);
+    return NULL;
+  }
+  base->_ndfid = *indf;
+  *indf = NDF__NOID;
+  Py_XINCREF(owner);
+  base->_owner = owner;
+  base->_iview = iview;
+  base->_depth = owner ? ((NDF*)owner)->_depth
+                       : (ndf_depth < NDF__MXVCTX ? ndf_depth : NDF__MXVCTX-1);
+  base->_nbytes = 0;
+  if (owner) ((NDF*)owner)->_nviews[iview]++;
+  ndf_ctxviews[base->_depth]++;
+
+  arr = (PyArrayObject*) PyArray_New( &PyArray_Type, ndim, rdim, typenum,
+                                      NULL, ptr, 0,
+                                      writeable ? NPY_CARRAY : NPY_CARRAY_RO,
+                                      NULL );
+  if (arr == NULL) {
+    Py_DECREF(base);
+    return NULL;
+  }
+  base->_nbytes = PyArray_NBYTES(arr);
+  STAR_MAPPED(base->_nbytes)
+
+  // this steals the reference to base, even on failure
+  if (PyArray_SetBaseObject( arr, (PyObject*)base ) < 0) {
+    Py_DECREF(arr);
+    return NULL;
+  }
+  return PyArray_Return(arr);
+}
 
 
 #ifdef USE_PY3K
@@ -1057,6 +3182,14 @@ initapi(void)
 
     if (PyType_Ready(&NDFType) < 0)
         return RETVAL;
+    if (PyType_Ready(&NDFMappingType) < 0)
+        return RETVAL;
+    if (PyType_Ready(&NDFChunkIterType) < 0)
+        return RETVAL;
+    if (PyType_Ready(&NDFSketchType) < 0)
+        return RETVAL;
+    if (NDFInfoType.tp_name == NULL)
+        PyStructSequence_InitType(&NDFInfoType, &NDFInfo_desc);
 
 #ifdef USE_PY3K
     m = PyModule_Create(&moduledef);
@@ -1068,6 +3201,13 @@ initapi(void)
 
     Py_INCREF(&NDFType);
     PyModule_AddObject(m, "api", (PyObject *)&NDFType);
+    Py_INCREF(&NDFSketchType);
+    PyModule_AddObject(m, "Sketch", (PyObject *)&NDFSketchType);
+
+    if (star_lock_create(m) < 0) {
+        m = NULL;
+        return RETVAL;
+    }
 
     StarlinkNDFError = PyErr_NewException("starlink.ndf.error", NULL, NULL);
     Py_INCREF(StarlinkNDFError);
@@ -0,0 +1,75 @@
+//
+// Serialisation of calls into the Starlink libraries
+
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+//
+// NDF and HDS are not thread-safe, so every call into them is bracketed
+// by STAR_BEGIN and STAR_END. These release the GIL, so that other Python
+// threads carry on while we wait for the disk, and hold a lock shared by
+// starlink.ndf.api and starlink.hds.api instead. The GIL is released
+// before waiting for the lock so that a thread holding the lock can
+// always get the GIL back afterwards.
+//
+// Nothing between STAR_BEGIN and STAR_END may touch Python objects, and
+// the block must not be left by return or goto. Error reporting through
+// EMS (errBegin, errLoad etc) keeps its context per thread and can be
+// done outside the lock. The time spent inside is counted by
+// star_stats.h when enabled.
+//
+// Include after Python.h and npy_3kcompat.h.
+
+#ifndef STARLINK_STAR_LOCK_H
+#define STARLINK_STAR_LOCK_H
+
+#include "pythread.h"
+#include "star_stats.h"
+
+static PyThread_type_lock star_lock = NULL;
+
+#define STAR_BEGIN Py_BEGIN_ALLOW_THREADS PyThread_acquire_lock(star_lock, WAIT_LOCK); STAR_STATS_BEGIN
+#define STAR_END   STAR_STATS_END PyThread_release_lock(star_lock); Py_END_ALLOW_THREADS
+
+// Creates the lock and attaches it to module m as "_star_lock". Called
+// when starlink.ndf.api is initialised. Returns -1 on failure.
+
+static int
+star_lock_create( PyObject *m )
+{
+    star_lock = PyThread_allocate_lock();
+    if (star_lock == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    return PyModule_AddObject(m, "_star_lock", NpyCapsule_FromVoidPtr(star_lock, NULL));
+}
+
+// Picks up the lock made by starlink.ndf.api. Returns -1 on failure.
+
+static int
+star_lock_import( void )
+{
+    PyObject *mod = PyImport_ImportModule("starlink.ndf.api");
+    if (mod == NULL) return -1;
+    PyObject *cap = PyObject_GetAttrString(mod, "_star_lock");
+    Py_DECREF(mod);
+    if (cap == NULL) return -1;
+    star_lock = (PyThread_type_lock)NpyCapsule_AsVoidPtr(cap);
+    Py_DECREF(cap);
+    return star_lock == NULL ? -1 : 0;
+}
+
+#endif
@@ -0,0 +1,190 @@
+//
+// Optional performance counters for the Starlink bindings
+
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+//
+// Each module keeps its own counters, per entry point: the number of
+// calls, the wall time spent inside Starlink (between STAR_BEGIN and
+// STAR_END) and copying data, the bytes mapped and copied, and the
+// largest number of bytes left mapped at once. Counting is off until
+// enable_stats() is called, when the only cost is a test of a flag in
+// each macro.
+//
+// STAR_ENTRY goes at the top of each function called from Python and
+// makes it the current entry point of the calling thread; the entry is
+// named after the function, less any pyndf_ or pydat_ prefix. Copies are
+// bracketed by STAR_COPY_BEGIN and STAR_COPY_END(nbytes), and their time
+// is taken out of the Starlink time when done inside the lock. Mapping
+// and unmapping are reported by STAR_MAPPED(nbytes) and
+// STAR_UNMAPPED(nbytes). The counters are updated without locking of
+// their own, so are approximate when several threads copy at once.
+//
+// Included by star_lock.h.
+
+#ifndef STARLINK_STAR_STATS_H
+#define STARLINK_STAR_STATS_H
+
+#include <string.h>
+#include <time.h>
+
+#if defined(_MSC_VER)
+# define STAR_TLS __declspec(thread)
+#else
+# define STAR_TLS __thread
+#endif
+
+typedef struct star_stat {
+    const char *name;
+    struct star_stat *next;
+    unsigned long calls;
+    double star_time;
+    double copy_time;
+    double mapped;
+    double copied;
+    double peak_mapped;
+} star_stat;
+
+static int star_stats_on = 0;
+static star_stat *star_stats_list = NULL;
+static double star_stats_live = 0.;
+static STAR_TLS star_stat *star_stats_current = NULL;
+static STAR_TLS int star_stats_locked = 0;
+
+static double
+star_clock( void )
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1.e-9*ts.tv_nsec;
+}
+
+static void
+star_stats_enter( star_stat *stat, const char *func )
+{
+    if (stat->name == NULL) {
+        stat->name = func;
+        stat->next = star_stats_list;
+        star_stats_list = stat;
+    }
+    stat->calls++;
+    star_stats_current = stat;
+}
+
+static void
+star_stats_copied( double start, size_t nbytes )
+{
+    star_stat *stat = star_stats_current;
+    if (stat == NULL) return;
+    double dt = star_clock() - start;
+    stat->copy_time += dt;
+    stat->copied += nbytes;
+    if (star_stats_locked) stat->star_time -= dt;
+}
+
+static void
+star_stats_mapped( double nbytes )
+{
+    star_stats_live += nbytes;
+    if (star_stats_live < 0.) star_stats_live = 0.;
+    star_stat *stat = star_stats_current;
+    if (stat == NULL || nbytes < 0) return;
+    stat->mapped += nbytes;
+    if (star_stats_live > stat->peak_mapped) stat->peak_mapped = star_stats_live;
+}
+
+#define STAR_ENTRY \
+    static star_stat _star_stat; \
+    if (star_stats_on) star_stats_enter(&_star_stat, __func__);
+
+#define STAR_STATS_BEGIN \
+    double _star_t0 = 0.; \
+    if (star_stats_on) { _star_t0 = star_clock(); star_stats_locked = 1; }
+
+#define STAR_STATS_END \
+    if (star_stats_on && _star_t0 > 0.) { \
+        star_stats_locked = 0; \
+        if (star_stats_current) star_stats_current->star_time += star_clock() - _star_t0; \
+    }
+
+#define STAR_COPY_BEGIN { double _star_c0 = star_stats_on ? star_clock() : 0.;
+#define STAR_COPY_END(nbytes) if (star_stats_on && _star_c0 > 0.) star_stats_copied(_star_c0, (nbytes)); }
+
+#define STAR_MAPPED(nbytes)   if (star_stats_on) star_stats_mapped((double)(nbytes));
+#define STAR_UNMAPPED(nbytes) if (star_stats_on) star_stats_mapped(-(double)(nbytes));
+
+// stats() -- returns the counters as a dictionary of dictionaries keyed
+// by entry point, leaving out those not called since the last reset.
+
+static PyObject *
+star_stats_get( PyObject *self, PyObject *args )
+{
+    star_stat *stat;
+    PyObject *item, *result = PyDict_New();
+    if (result == NULL) return NULL;
+    for (stat = star_stats_list; stat; stat = stat->next) {
+        if (stat->calls == 0) continue;
+        const char *name = stat->name;
+        if (strncmp(name, "pyndf_", 6) == 0 || strncmp(name, "pydat_", 6) == 0) name += 6;
+        item = Py_BuildValue("{s:k,s:d,s:d,s:d,s:d,s:d}",
+                             "calls", stat->calls,
+                             "star_time", stat->star_time,
+                             "copy_time", stat->copy_time,
+                             "mapped", stat->mapped,
+                             "copied", stat->copied,
+                             "peak_mapped", stat->peak_mapped);
+        if (item == NULL || PyDict_SetItemString(result, name, item) < 0) {
+            Py_XDECREF(item);
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(item);
+    }
+    return result;
+}
+
+static PyObject *
+star_stats_reset( PyObject *self, PyObject *args )
+{
+    star_stat *stat;
+    for (stat = star_stats_list; stat; stat = stat->next) {
+        stat->calls = 0;
+        stat->star_time = stat->copy_time = 0.;
+        stat->mapped = stat->copied = stat->peak_mapped = 0.;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+star_stats_enable( PyObject *self, PyObject *args )
+{
+    int on = 1;
+    if (!PyArg_ParseTuple(args, "|i:enable_stats", &on)) return NULL;
+    star_stats_on = on;
+    Py_RETURN_NONE;
+}
+
+#define STAR_STATS_METHODS \
+    {"stats", (PyCFunction)star_stats_get, METH_NOARGS, \
+     "counters = stats() -- returns performance counters per entry point, each a dictionary of: calls, star_time\n" \
+     "(seconds inside Starlink), copy_time (seconds copying), mapped and copied (bytes) and peak_mapped (most bytes\n" \
+     "left mapped at once). Only counted after enable_stats()."}, \
+    {"reset_stats", (PyCFunction)star_stats_reset, METH_NOARGS, \
+     "reset_stats() -- zeroes the performance counters."}, \
+    {"enable_stats", (PyCFunction)star_stats_enable, METH_VARARGS, \
+     "enable_stats(on=True) -- switches counting for stats() on or off."},
+
+#endif
@@ -0,0 +1,46 @@
+import unittest
+import starlink.ndf.catalog as catalog
+import os.path
+import shutil
+import tempfile
+
+class TestCatalog(unittest.TestCase):
+
+    def setUp(self):
+        self.tmpdir = tempfile.mkdtemp()
+        self.cat = catalog.Catalog( os.path.join(self.tmpdir, 'cat.db'), keywords=['EXPTIME'] )
+        self.path = os.path.abspath( os.path.join('data','ndf_test.sdf') )
+
+    def tearDown(self):
+        self.cat.close()
+        shutil.rmtree( self.tmpdir )
+
+    def test_update(self):
+        self.assertEqual( self.cat.update('data', processes=1), (1, 0) )
+        # nothing has changed so nothing is rescanned
+        self.assertEqual( self.cat.update('data', processes=1), (0, 0) )
+        self.assertEqual( self.cat.find(title='Test%'), [self.path] )
+        self.assertEqual( self.cat.find(title='Nothing'), [] )
+        self.assertEqual( self.cat.info(self.path)['units'], 'counts' )
+
+    def test_workers(self):
+        # enough files for them to be shared out between the workers
+        scandir = os.path.join(self.tmpdir, 'scan')
+        os.mkdir( scandir )
+        copies = [os.path.join(scandir, 'ndf_test%d.sdf' % i) for i in range(5)]
+        for copy in copies:
+            shutil.copy( self.path, copy )
+        self.assertEqual( self.cat.update(scandir, processes=2), (len(copies), 0) )
+        self.assertEqual( self.cat.update('data', processes=1), (1, 0) )
+        expected = self.cat.info(self.path)
+        self.assertEqual( expected['title'], 'Test Data' )
+        for copy in copies:
+            self.assertEqual( self.cat.info(copy), expected )
+        self.assertEqual( self.cat.find(EXPTIME=4), sorted(copies + [self.path]) )
+
+    def test_card_value(self):
+        self.assertEqual( catalog._card_value("'O''Hara  '  / name"), "O'Hara" )
+        self.assertEqual( catalog._card_value(" +4.0E+000 / EXPOSURE"), "+4.0E+000" )
+
+if __name__ == "__main__":
+    unittest.main()
@@ -1,6 +1,11 @@
 import unittest
 from starlink.ndf.Ndf import Ndf
 import os.path
+import numpy
+try:
+    from collections.abc import Mapping
+except ImportError:
+    from collections import Mapping
 
 class TestFullRead(unittest.TestCase):
 
@@ -17,6 +22,30 @@ class TestFullRead(unittest.TestCase):
     def test_units(self):
         self.assertEqual( self.ndf.units, 'counts' )
 
+    def test_lazy(self):
+        self.assertNotIn( 'data', self.ndf.__dict__ )
+        data = self.ndf.data
+        self.assertIs( self.ndf.__dict__['data'], data )
+        self.assertIs( self.ndf.data, data )
+
+    def test_head(self):
+        head = self.ndf.head
+        self.assertIn( 'FITS', head )
+        fits = head['FITS']
+        self.assertTrue( len(fits) > 0 )
+        self.assertIs( head['FITS'], fits )
+        self.assertTrue( isinstance(head['PROVENANCE'], Mapping) )
+
+    def test_todict(self):
+        head = self.ndf.head.todict()
+        self.assertTrue( isinstance(head['PROVENANCE'], dict) )
+        self.assertTrue( numpy.array_equal(head['FITS'], self.ndf.head['FITS']) )
+
+    def test_close(self):
+        title = self.ndf.title
+        self.ndf.close()
+        self.assertEqual( self.ndf.title, title )
+
 """
 License
 =======
@@ -0,0 +1,136 @@
+import unittest
+import starlink.ndf.api as ndf
+import starlink.hds.api as hds
+import numpy
+import os.path
+import threading
+
+class TestRead(unittest.TestCase):
+
+    def setUp(self):
+        ndf.begin()
+        self.indf = ndf.open( os.path.join('data','ndf_test.sdf') )
+
+    def tearDown(self):
+        ndf.end()
+
+    def test_view(self):
+        data = self.indf.read('Data')
+        view = self.indf.read('Data', copy=False)
+        self.assertTrue( numpy.array_equal(data, view) )
+        self.assertFalse( view.flags.writeable )
+
+    def test_view_end(self):
+        # ending a context would unmap data still being viewed
+        ndf.begin()
+        indf = ndf.open( os.path.join('data','ndf_test.sdf') )
+        view = indf.read('Data', copy=False)
+        del indf
+        with self.assertRaises(RuntimeError):
+            ndf.end()
+        total = view.sum()
+        del view
+        ndf.end()
+        self.assertEqual( total, self.indf.read('Data').sum() )
+
+    def test_view_missing(self):
+        self.assertIsNone( self.indf.read('Var', copy=False) )
+
+    def test_type(self):
+        data = self.indf.read('Data')
+        ddata = self.indf.read('Data', type='_DOUBLE')
+        self.assertEqual( ddata.dtype, numpy.float64 )
+        self.assertTrue( numpy.array_equal(data, ddata) )
+        self.assertEqual( self.indf.read('Data', type=numpy.float32).dtype, numpy.float32 )
+
+    def test_read_many(self):
+        comps = self.indf.read_many(['Data','Var'], type='_DOUBLE')
+        self.assertIsNone( comps['Var'] )
+        self.assertEqual( comps['Data'].dtype, numpy.float64 )
+        self.assertTrue( numpy.array_equal(comps['Data'], self.indf.read('Data')) )
+        # names are matched in full or abbreviated to three characters,
+        # and each array can be asked for once
+        for bad in (['Data','DATA'], ['Var','Error'], ['Qu'], ['Title'], ['Quality','Qual']):
+            with self.assertRaises(ValueError):
+                self.indf.read_many(bad)
+
+    def test_info(self):
+        info = ndf.info( os.path.join('data','ndf_test.sdf') )
+        self.assertEqual( info.shape, tuple(self.indf.dim()) )
+        self.assertTrue( numpy.array_equal(numpy.array(info.bound), self.indf.bound()) )
+        self.assertEqual( info.title, 'Test Data' )
+        self.assertEqual( info.units, 'counts' )
+        self.assertIn( 'FITS', info.extensions )
+
+    def test_info_missing(self):
+        with self.assertRaises(IOError):
+            ndf.info('shouldnotbepresent')
+
+    def test_records(self):
+        loc = hds._transfer(self.indf.xloc('PROVENANCE', 'READ'))
+        anc = loc.find('ANCESTORS')
+        recs = anc.records()
+        self.assertEqual( recs.shape, (2,) )
+        self.assertEqual( recs['PATH'][1].strip(), b'file2' )
+        self.assertTrue( numpy.array_equal(recs['INDEX'], [0., 1.5]) )
+        self.assertIsNone( loc.records() )
+        path = anc.cell([1]).find('PATH')
+        with self.assertRaises(IOError):
+            path.records()
+        path.annul()
+        anc.annul()
+        loc.annul()
+
+    def test_stats(self):
+        ndf.reset_stats()
+        self.indf.read('Data')
+        self.assertEqual( ndf.stats(), {} )
+        ndf.enable_stats()
+        try:
+            data = self.indf.read('Data')
+            self.indf.read('Data')
+            view = self.indf.read('Data', copy=False)
+            stats = ndf.stats()
+        finally:
+            ndf.enable_stats(False)
+        self.assertEqual( stats['read']['calls'], 3 )
+        self.assertEqual( stats['read']['copied'], 2*data.nbytes )
+        self.assertEqual( stats['read']['mapped'], 3*data.nbytes )
+        self.assertEqual( stats['read']['peak_mapped'], data.nbytes )
+        self.assertTrue( stats['read']['star_time'] >= 0. )
+        ndf.reset_stats()
+        self.assertEqual( ndf.stats(), {} )
+
+    def test_badtype(self):
+        with self.assertRaises(ValueError):
+            self.indf.read('Data', type=numpy.complex64)
+
+    def test_chunks(self):
+        data = self.indf.read('Data')
+        out = numpy.zeros_like(data)
+        nchunk = 0
+        for offset, chunk in self.indf.iter_chunks('Data', 2):
+            self.assertTrue( chunk.size <= 2 )
+            sl = tuple(slice(o, o+n) for o, n in zip(offset, chunk.shape))
+            out[sl] = chunk
+            nchunk += 1
+        self.assertTrue( nchunk > 1 )
+        self.assertTrue( numpy.array_equal(data, out) )
+
+    def test_threads(self):
+        data = self.indf.read('Data')
+        results = []
+        def reader():
+            for i in range(20):
+                results.append( self.indf.read('Data') )
+        threads = [threading.Thread(target=reader) for i in range(4)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual( len(results), 80 )
+        for arr in results:
+            self.assertTrue( numpy.array_equal(data, arr) )
+
+if __name__ == "__main__":
+    unittest.main()
@@ -2,6 +2,10 @@ import unittest
 import starlink.ndf.api as ndf
 import starlink.hds.api as hds
 import numpy
+import pickle
+import warnings
+from starlink.ndf.Appender import Appender
+from starlink.ndf.Ndf import HdsMapping
 import os.path
 import os
 
@@ -23,7 +27,7 @@ class TestSimpleNDF(unittest.TestCase):
                            numpy.array([0,0]),numpy.array([4,4]))
 
         # map primary data to make sure NDF does not complain
-        ptr,el = newindf.map('DATA','_REAL','WRITE')
+        ptr = newindf.map('DATA','_REAL','WRITE')
 
         # make sure we got a file
         self.assertTrue( os.path.exists( self.testndf ), "Test existence of NDF file" )
@@ -44,8 +48,9 @@ class TestSimpleNDF(unittest.TestCase):
         ccd = numpy.zeros([5,5])
 
         # map primary data
-        ptr,el = newindf.map('DATA','_REAL','WRITE')
-        ndf.ndf_numpytoptr(ccd,ptr,el,'_REAL')
+        ptr = newindf.map('DATA','_REAL','WRITE')
+        ndf.ndf_numpytoptr(ccd,ptr,ptr.size,'_REAL')
+        del ptr
 
         # shut down ndf system
         newindf.annul()
@@ -53,6 +58,407 @@ class TestSimpleNDF(unittest.TestCase):
         # make sure we got a file
         self.assertTrue( os.path.exists( self.testndf ), "Test existence of NDF file" )
 
+    def test_getslice(self):
+        indf = ndf.open(self.testndf,'WRITE','NEW')
+        newindf = indf.new('_REAL',1,
+                           numpy.array([1]),numpy.array([5]))
+        hdsloc = hds._transfer(newindf.xnew('PAMELA','STRUCT'))
+        hdsloc.new('ARR','_INTEGER',2,numpy.array([4,3]))
+        arr = hdsloc.find('ARR')
+        full = numpy.arange(12).reshape(3,4)
+        arr.put('_INTEGER',2,numpy.array([4,3]),full)
+
+        self.assertTrue( numpy.array_equal(arr.get(), full) )
+        for sub in (1, (1,2), (slice(None),2), slice(0,2),
+                    (slice(None,None,-2),slice(1,None,2)), (), slice(2,2)):
+            self.assertTrue( numpy.array_equal(arr.get(sub), full[sub]), sub )
+        self.assertEqual( arr.get((-1,-1)), 11 )
+        with self.assertRaises(IndexError):
+            arr.get(3)
+        with self.assertRaises(IndexError):
+            arr.get((0,0,0))
+        arr.annul()
+        hdsloc.annul()
+        newindf.annul()
+
+    def test_hdsmap(self):
+        indf = ndf.open(self.testndf,'WRITE','NEW')
+        newindf = indf.new('_REAL',1,
+                           numpy.array([1]),numpy.array([5]))
+        hdsloc = hds._transfer(newindf.xnew('PAMELA','STRUCT'))
+        hdsloc.new('ARR','_DOUBLE',2,numpy.array([4,3]))
+        arr = hdsloc.find('ARR')
+
+        view = arr.map('WRITE')
+        self.assertEqual( view.shape, (3,4) )
+        view[...] = numpy.arange(12).reshape(3,4)
+        del view
+        self.assertTrue( numpy.array_equal(arr.get(), numpy.arange(12).reshape(3,4)) )
+
+        view = arr.map('UPDATE', '_INTEGER')
+        self.assertEqual( view.dtype, numpy.int32 )
+        view[1] *= 2
+        # the view outlives the locator
+        arr.annul()
+        del view
+        arr = hdsloc.find('ARR')
+        view = arr.map()
+        self.assertFalse( view.flags.writeable )
+        self.assertEqual( list(view[1]), [8.,10.,12.,14.] )
+        del view
+        arr.annul()
+        hdsloc.annul()
+        newindf.annul()
+
+    def test_hdsmapping_undefined(self):
+        indf = ndf.open(self.testndf,'WRITE','NEW')
+        newindf = indf.new('_REAL',1,
+                           numpy.array([1]),numpy.array([5]))
+        hdsloc = hds._transfer(newindf.xnew('PAMELA','STRUCT'))
+        hdsloc.new('SET','_INTEGER',0,[])
+        hdsloc.new('UNSET','_INTEGER',0,[])
+        loc = hdsloc.find('SET')
+        loc.put('_INTEGER',0,[],3)
+        loc.annul()
+
+        # undefined primitives are left out whichever way it is read
+        head = HdsMapping(hdsloc)
+        self.assertEqual( list(head), ['SET'] )
+        self.assertNotIn( 'UNSET', head )
+        with self.assertRaises(KeyError):
+            head['UNSET']
+        self.assertEqual( head['SET'], 3 )
+        self.assertEqual( head.todict(), {'SET' : 3} )
+        hdsloc.annul()
+        newindf.annul()
+
+    def test_hdsput(self):
+        indf = ndf.open(self.testndf,'WRITE','NEW')
+        newindf = indf.new('_REAL',1,
+                           numpy.array([1]),numpy.array([5]))
+        hdsloc = hds._transfer(newindf.xnew('PAMELA','STRUCT'))
+        values = numpy.arange(6).reshape(2,3)
+        for htype, dtype in (('_WORD', numpy.int16), ('_UWORD', numpy.uint16),
+                             ('_LOGICAL', numpy.int32), ('_INT64', numpy.int64),
+                             ('_DOUBLE', numpy.float64)):
+            hdsloc.new(htype[1:],htype,2,[3,2])
+            loc = hdsloc.find(htype[1:])
+            # strided float input is converted on the way
+            loc.put(htype,2,[3,2],numpy.arange(12.).reshape(2,6)[:,::2]/2)
+            self.assertEqual( loc.get().dtype, dtype )
+            self.assertTrue( numpy.array_equal(loc.get(), values) )
+            # matching arrays go straight through
+            loc.put(htype,2,[3,2],(values+1).astype(dtype))
+            self.assertTrue( numpy.array_equal(loc.get(), values+1) )
+            loc.annul()
+
+        hdsloc.new('NAMES','_CHAR*6',1,[2])
+        loc = hdsloc.find('NAMES')
+        loc.put('_CHAR*6',1,[2],['ab','cdefgh'])
+        self.assertEqual( list(loc.get()), [b'ab    ', b'cdefgh'] )
+        loc.annul()
+
+        with self.assertRaises(ValueError):
+            hdsloc.new('BAD','_UWROD',0,[])
+        with self.assertRaises(ValueError):
+            hdsloc.find('WORD').put('_WORD',2,[3,2],numpy.zeros(5))
+        hdsloc.annul()
+        newindf.annul()
+
+    def test_readword(self):
+        indf = ndf.open(self.testndf,'WRITE','NEW')
+        newindf = indf.new('_WORD',2,
+                           numpy.array([0,0]),numpy.array([4,4]))
+        ptr = newindf.map('DATA','_WORD','WRITE')
+        ndf.ndf_numpytoptr(numpy.arange(25),ptr,ptr.size,'_WORD')
+        del ptr
+        newindf.unmap('DATA')
+
+        # read back without widening
+        data = newindf.read('DATA')
+        self.assertEqual( data.dtype, numpy.int16 )
+        self.assertEqual( data.shape, (5,5) )
+        self.assertTrue( numpy.array_equal( data.ravel(), numpy.arange(25) ) )
+        newindf.annul()
+
+    def test_nan(self):
+        indf = ndf.open(self.testndf,'WRITE','NEW')
+        newindf = indf.new('_REAL',1,
+                           numpy.array([1]),numpy.array([5]))
+        ptr = newindf.map('DATA','_REAL','WRITE')
+        ccd = numpy.array([1.,numpy.nan,3.,4.,numpy.nan])
+        ndf.ndf_numpytoptr(ccd,ptr,ptr.size,'_REAL',nan=True)
+        del ptr
+        newindf.unmap('DATA')
+
+        # bad values are only translated on request
+        data = newindf.read('DATA')
+        self.assertEqual( data[1], ndf.ndf_getbadpixval('_REAL') )
+        data = newindf.read('DATA', nan=True)
+        self.assertTrue( numpy.isnan(data[1]) and numpy.isnan(data[4]) )
+        self.assertEqual( data[2], 3. )
+        newindf.annul()
+
+    def test_readmany(self):
+        indf = ndf.open(self.testndf,'WRITE','NEW')
+        newindf = indf.new('_REAL',2,
+                           numpy.array([0,0]),numpy.array([2,3]))
+        for comp, value in (('DATA',1.),('VARIANCE',2.)):
+            ptr = newindf.map(comp,'_REAL','WRITE')
+            ptr[...] = value
+            del ptr
+            newindf.unmap(comp)
+        ptr = newindf.map('QUALITY','_UBYTE','WRITE')
+        ndf.ndf_numpytoptr(numpy.arange(12),ptr,ptr.size,'_UBYTE')
+        del ptr
+        newindf.unmap('QUALITY')
+
+        comps = newindf.read_many(['DATA','VARIANCE','QUALITY'])
+        self.assertEqual( comps['DATA'].shape, (4,3) )
+        self.assertTrue( numpy.all(comps['DATA'] == 1.) )
+        self.assertTrue( numpy.all(comps['VARIANCE'] == 2.) )
+        self.assertEqual( comps['QUALITY'].dtype, numpy.uint8 )
+        self.assertTrue( numpy.array_equal(comps['QUALITY'].ravel(), numpy.arange(12)) )
+        newindf.annul()
+
+    def test_mapview(self):
+        indf = ndf.open(self.testndf,'WRITE','NEW')
+        newindf = indf.new('_REAL',2,
+                           numpy.array([0,0]),numpy.array([4,2]))
+        data = newindf.map('DATA','_REAL','WRITE')
+        self.assertEqual( data.shape, (3,5) )
+        self.assertEqual( data.dtype, numpy.float32 )
+        data[...] = numpy.arange(15).reshape(3,5)
+        # the view, or anything derived from it, blocks unmapping
+        row = data[1]
+        del data
+        with self.assertRaises(RuntimeError):
+            newindf.unmap('DATA')
+        with self.assertRaises(RuntimeError):
+            newindf.annul()
+        del row
+        newindf.unmap('DATA')
+
+        # modify in place
+        data = newindf.map('DATA','_REAL','UPDATE')
+        data *= 2
+        del data
+        newindf.unmap('DATA')
+        self.assertTrue( numpy.array_equal(newindf.read('DATA').ravel(), 2*numpy.arange(15)) )
+
+        data = newindf.map('DATA','_DOUBLE','READ')
+        self.assertFalse( data.flags.writeable )
+        del data
+        newindf.unmap('DATA')
+        newindf.annul()
+
+    def test_write(self):
+        indf = ndf.open(self.testndf,'WRITE','NEW')
+        newindf = indf.new('_REAL',2,
+                           numpy.array([0,0]),numpy.array([4,2]))
+        # float64 with strides, converted as it is written
+        ccd = numpy.arange(30.).reshape(3,10)[:,::2]
+        ccd[1,1] = numpy.nan
+        newindf.write('DATA', ccd, nan=True)
+        newindf.write('QUALITY', numpy.ones([3,5]))
+        with self.assertRaises(ValueError):
+            newindf.write('VARIANCE', numpy.zeros([5,3]))
+
+        data = newindf.read('DATA', nan=True)
+        self.assertEqual( data.dtype, numpy.float32 )
+        self.assertTrue( numpy.isnan(data[1,1]) )
+        data[1,1] = ccd[1,1] = 0.
+        self.assertTrue( numpy.array_equal(data, ccd) )
+        self.assertTrue( numpy.all(newindf.read('QUALITY') == 1) )
+        self.assertIsNone( newindf.read('VARIANCE') )
+
+        # contiguous input of the mapped type is translated as it is
+        # copied, leaving the input alone; byte-swapped input is not
+        for dtype in ('=f4', '>f4'):
+            var = numpy.arange(15, dtype=dtype).reshape(3,5)
+            var[2,4] = numpy.nan
+            newindf.write('VARIANCE', var, nan=True)
+            self.assertTrue( numpy.isnan(var[2,4]) )
+            self.assertEqual( newindf.read('VARIANCE')[2,4], ndf.ndf_getbadpixval('_REAL') )
+            self.assertEqual( newindf.read('VARIANCE')[1,2], 7. )
+        newindf.annul()
+
+    def test_subscript(self):
+        indf = ndf.open(self.testndf,'WRITE','NEW')
+        newindf = indf.new('_INTEGER',3,
+                           numpy.array([-1,2,0]),numpy.array([4,5,4]))
+        full = numpy.arange(120, dtype=numpy.int32).reshape(5,4,6)
+        newindf.write('DATA', full)
+
+        for key in (1, (1,2), (slice(None),2), slice(0,2), (1,2,3), (-1,-1,-1),
+                    (slice(None,None,2),slice(1,None,2)), (slice(None,None,-3),0,slice(4,0,-2)),
+                    (), slice(2,2), (slice(1,5,3),slice(None),slice(1,2))):
+            self.assertTrue( numpy.array_equal(newindf[key], full[key]), key )
+        with self.assertRaises(IndexError):
+            newindf[5]
+        with self.assertRaises(IndexError):
+            newindf[0,0,0,0]
+
+        sect = newindf.section((slice(1,3),2))
+        self.assertEqual( sect.bound().tolist(), [[1,4,-1],[2,4,4]] )
+        self.assertTrue( numpy.array_equal(sect.read('DATA'), full[1:3,2:3]) )
+        self.assertTrue( numpy.array_equal(sect[:,0,::2], full[1:3,2,::2]) )
+        sect.annul()
+        with self.assertRaises(ValueError):
+            newindf.section(slice(None,None,2))
+        newindf.annul()
+
+    def test_binned(self):
+        indf = ndf.open(self.testndf,'WRITE','NEW')
+        newindf = indf.new('_REAL',2,
+                           numpy.array([1,1]),numpy.array([10,7]))
+        full = numpy.arange(70, dtype=numpy.float32).reshape(7,10)
+        full[:3,:4] = numpy.nan
+        newindf.write('DATA', full, nan=True)
+        padded = numpy.empty((9,12))
+        padded.fill(numpy.nan)
+        padded[:7,:10] = full
+        blocks = padded.reshape(3,3,3,4).swapaxes(1,2).reshape(3,3,12)
+
+        with warnings.catch_warnings():
+            warnings.simplefilter('ignore', RuntimeWarning)
+            expected = {'mean' : numpy.nanmean(blocks, 2), 'max' : numpy.nanmax(blocks, 2),
+                        'sum' : numpy.nansum(blocks, 2)}
+        expected['sum'][0,0] = numpy.nan
+        for method in expected:
+            # small chunks so that blocks straddle them
+            binned = newindf.read_binned('DATA', (3,4), method, max_elements=7)
+            self.assertEqual( binned.dtype, numpy.float64 )
+            self.assertTrue( numpy.allclose(binned, expected[method], equal_nan=True), method )
+        self.assertTrue( numpy.allclose(newindf.read_binned('DATA', 1), full, equal_nan=True) )
+        self.assertIsNone( newindf.read_binned('VARIANCE', 2) )
+        with self.assertRaises(ValueError):
+            newindf.read_binned('DATA', (2,2,2))
+        with self.assertRaises(ValueError):
+            newindf.read_binned('DATA', 2, 'median')
+        newindf.annul()
+
+    def test_statistics(self):
+        indf = ndf.open(self.testndf,'WRITE','NEW')
+        newindf = indf.new('_DOUBLE',3,
+                           numpy.array([1,1,1]),numpy.array([500,4,3]))
+        full = 1.e8 + numpy.random.RandomState(1).normal(size=(3,4,500))
+        full[1,2,::3] = numpy.nan
+        full[2,3,:] = numpy.nan
+        newindf.write('DATA', full, nan=True)
+
+        def check(st, axis):
+            with warnings.catch_warnings():
+                warnings.simplefilter('ignore', RuntimeWarning)
+                good = ~numpy.isnan(full)
+                expected = {'count' : good.sum(axis), 'bad' : (~good).sum(axis),
+                            'mean' : numpy.nanmean(full, axis), 'std' : numpy.nanstd(full, axis),
+                            'min' : numpy.nanmin(full, axis), 'max' : numpy.nanmax(full, axis)}
+            for key in expected:
+                self.assertTrue( numpy.allclose(st[key], expected[key], rtol=1.e-12, atol=1.e-8,
+                                                equal_nan=True), (axis, key) )
+
+        check(newindf.statistics('DATA'), None)
+        # chunks smaller than a row, and several threads
+        check(newindf.statistics('DATA', max_elements=300, nthread=3), None)
+        for axis in (0, 1, 2, -1):
+            check(newindf.statistics('DATA', axis, max_elements=700, nthread=2), axis)
+        self.assertIsNone( newindf.statistics('VARIANCE') )
+        with self.assertRaises(ValueError):
+            newindf.statistics('DATA', 3)
+        newindf.annul()
+
+    def test_statistics_threads(self):
+        # chunks big enough to be shared out between threads, which
+        # must agree with a single thread
+        indf = ndf.open(self.testndf,'WRITE','NEW')
+        newindf = indf.new('_REAL',3,
+                           numpy.array([1,1,1]),numpy.array([5000,8,6]))
+        full = numpy.random.RandomState(2).normal(size=(6,8,5000))
+        full[1,2,::3] = numpy.nan
+        newindf.write('DATA', full, nan=True)
+        for axis in (None, 0, 1, 2):
+            one = newindf.statistics('DATA', axis, nthread=1)
+            for mxpix in (200000, 1 << 20):
+                many = newindf.statistics('DATA', axis, max_elements=mxpix, nthread=3)
+                for key in one:
+                    self.assertTrue( numpy.allclose(many[key], one[key], rtol=1.e-12), (axis, mxpix, key) )
+        newindf.annul()
+
+    def test_sketch(self):
+        indf = ndf.open(self.testndf,'WRITE','NEW')
+        newindf = indf.new('_REAL',2,
+                           numpy.array([1,1]),numpy.array([400,250]))
+        full = numpy.random.RandomState(2).normal(size=(250,400)).astype(numpy.float32)
+        full[::4,::3] = numpy.nan
+        newindf.write('DATA', full, nan=True)
+        good = full[~numpy.isnan(full)]
+
+        q = numpy.array([0., 0.01, 0.25, 0.5, 0.9, 1.])
+        sketch = newindf.sketch('DATA', k=100, max_elements=5000)
+        self.assertEqual( sketch.n, good.size )
+        values = sketch.quantile(q)
+        self.assertEqual( values[0], good.min() )
+        self.assertEqual( values[-1], good.max() )
+        # rank errors within a few times 1/k
+        ranks = numpy.searchsorted(numpy.sort(good), values)/float(good.size)
+        self.assertTrue( numpy.all(numpy.abs(ranks - q) < 0.05), ranks )
+
+        # merging, adding to a sketch and pickling all give sketches of everything
+        other = newindf.sketch('DATA', k=100)
+        other.merge(sketch)
+        newindf.sketch('DATA', sketch=sketch)
+        copy = pickle.loads(pickle.dumps(sketch))
+        for sk in (other, sketch, copy):
+            self.assertEqual( sk.n, 2*good.size )
+            self.assertTrue( abs(numpy.searchsorted(numpy.sort(good), sk.quantile(0.5))/float(good.size) - 0.5) < 0.05 )
+        self.assertEqual( copy.quantile(0.3), sketch.quantile(0.3) )
+        with self.assertRaises(ValueError):
+            sketch.merge(sketch)
+
+        counts, edges = newindf.histogram('DATA', 20, max_elements=5000)
+        ncounts, nedges = numpy.histogram(good, 20)
+        self.assertTrue( numpy.allclose(edges, nedges) )
+        self.assertTrue( numpy.array_equal(counts, ncounts) )
+        counts, edges = newindf.histogram('DATA', 10, (-1.,1.))
+        self.assertTrue( numpy.array_equal(counts, numpy.histogram(good, 10, (-1.,1.))[0]) )
+        self.assertIsNone( newindf.histogram('VARIANCE') )
+        with self.assertRaises(ValueError):
+            newindf.histogram('DATA', 10, (1.,1.))
+        newindf.annul()
+
+    def test_appender(self):
+        frames = numpy.arange(70.).reshape(7,2,5)
+        app = Appender(self.testndf, (2,5), capacity=2)
+        app.append(frames[0])
+        app.append(frames[1:4], var=numpy.ones([3,2,5]))
+        with self.assertRaises(ValueError):
+            app.append(numpy.zeros([5,2]))
+        app.close()
+
+        with Appender(self.testndf) as app:
+            self.assertEqual( app.nframe, 4 )
+            app.append(frames[4:])
+            self.assertEqual( app.nframe, 7 )
+
+        indf = ndf.open(self.testndf)
+        self.assertEqual( list(indf.dim()), [7,2,5] )
+        self.assertTrue( numpy.array_equal(indf.read('DATA'), frames) )
+        var = indf.read('VARIANCE', nan=True)
+        self.assertTrue( numpy.all(var[1:4] == 1) )
+        self.assertTrue( numpy.all(numpy.isnan(var[0])) )
+        indf.annul()
+
+    def test_appender_empty(self):
+        # an NDF cannot have an empty axis, so one with no frames goes
+        with Appender(self.testndf, (2,5)) as app:
+            self.assertEqual( app.nframe, 0 )
+        self.assertFalse( os.path.exists(self.testndf) )
+        with self.assertRaises(IOError):
+            ndf.open(self.testndf)
+        # for tearDown
+        open(self.testndf, 'w').close()
+
 if __name__ == "__main__":
     unittest.main()
 